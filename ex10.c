@@ -1,11 +1,14 @@
 // deadlock_watchdog.c
 // Cenário de deadlock proposital + watchdog + correção com ordem total.
+// O watchdog detecta o deadlock por ciclo no grafo de espera (quem espera por
+// quem, via dono de cada lock), não só por falta de progresso.
 // Compile: gcc -O2 -pthread deadlock_watchdog.c -o deadlock
 // Execute: ./deadlock
-// Opcional: ./deadlock -r 5 -w 5 -t 3 -d 15
+// Opcional: ./deadlock -r 5 -w 5 -t 3 -d 15 -g block
 
 #define _GNU_SOURCE
 #include <pthread.h>
+#include <sched.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,11 +32,39 @@ static inline void sleep_ms(int ms){
 }
 
 // ---------- configuração com defaults seguros p/ “online” ----------
+typedef enum {
+  DET_PROGRESS = 0,  // só falta de progresso por T s (heurística original)
+  DET_POLL,          // watchdog varre o grafo de espera a cada poll_ms
+  DET_BLOCK          // quem bloqueia numa aquisição procura o ciclo na hora
+} detector_t;
+static const char *detector_names[] = { "progress", "poll", "block" };
+
+typedef enum {
+  REC_NONE = 0,  // deadlock encerra a fase (comportamento original)
+  REC_TIMED,     // pthread_mutex_timedlock: quem espera mais que lock_timeout_ms desiste
+  REC_GRAPH      // ciclo confirmado no grafo → uma vítima do ciclo desiste
+} recovery_t;
+static const char *recovery_names[] = { "none", "timed", "graph" };
+
+typedef enum { VICTIM_YOUNGEST = 0, VICTIM_FEWEST, VICTIM_RANDOM } victim_t;
+static const char *victim_names[] = { "youngest", "fewest", "random" };
+
 typedef struct {
   int R;                 // recursos (mutexes)
   int W;                 // workers
   int watchdog_timeout;  // s sem progresso => suspeita
   int duration;          // s por fase
+  detector_t detector;   // como detectar deadlock
+  int poll_ms;           // período da varredura do grafo (DET_POLL)
+  recovery_t recovery;   // recuperação: vítima solta os locks e tenta de novo
+  int lock_timeout_ms;   // REC_TIMED
+  victim_t victim;       // REC_GRAPH: quem do ciclo desiste
+  int lockdep;           // valida a ordem de aquisição (arestas "segurava A, pediu B")
+  int annotate;          // 0 = locks crus, sem estado para o watchdog (-A)
+  int no_sleep;          // sem o trabalho simulado (sleeps): expõe o custo da anotação
+  int bench;             // -b: fase segura sem sleeps, com e sem anotação
+  int prof;              // perfil por lock: aquisições, disputa, espera e posse (-P)
+  const char *prof_csv;  // -c: mapa de calor segurava×pediu em CSV
 } config_t;
 
 static void parse_args(int argc, char**argv, config_t *cfg){
@@ -42,17 +73,56 @@ static void parse_args(int argc, char**argv, config_t *cfg){
   cfg->W = 5;
   cfg->watchdog_timeout = 3;
   cfg->duration = 12;
+  cfg->detector = DET_POLL;
+  cfg->poll_ms = 1;
+  cfg->recovery = REC_NONE;
+  cfg->lock_timeout_ms = 20;
+  cfg->victim = VICTIM_YOUNGEST;
+  cfg->lockdep = 0;
+  cfg->annotate = 1;
+  cfg->no_sleep = 0;
+  cfg->bench = 0;
+  cfg->prof = 0;
+  cfg->prof_csv = NULL;
 
   int opt;
-  while ((opt = getopt(argc, argv, "r:w:t:d:h")) != -1){
+  while ((opt = getopt(argc, argv, "r:w:t:d:g:p:x:l:v:kAnbPc:h")) != -1){
     switch (opt){
       case 'r': cfg->R = atoi(optarg); break;
       case 'w': cfg->W = atoi(optarg); break;
       case 't': cfg->watchdog_timeout = atoi(optarg); break;
       case 'd': cfg->duration = atoi(optarg); break;
+      case 'p': cfg->poll_ms = atoi(optarg); break;
+      case 'l': cfg->lock_timeout_ms = atoi(optarg); break;
+      case 'k': cfg->lockdep = 1; break;
+      case 'A': cfg->annotate = 0; break;
+      case 'n': cfg->no_sleep = 1; break;
+      case 'b': cfg->bench = 1; break;
+      case 'P': cfg->prof = 1; break;
+      case 'c': cfg->prof = 1; cfg->prof_csv = optarg; break;
+      case 'x':
+        if (!strcmp(optarg, "none")) { cfg->recovery = REC_NONE; break; }
+        if (!strcmp(optarg, "timed")) { cfg->recovery = REC_TIMED; break; }
+        if (!strcmp(optarg, "graph")) { cfg->recovery = REC_GRAPH; break; }
+        goto usage;
+      case 'v':
+        if (!strcmp(optarg, "youngest")) { cfg->victim = VICTIM_YOUNGEST; break; }
+        if (!strcmp(optarg, "fewest")) { cfg->victim = VICTIM_FEWEST; break; }
+        if (!strcmp(optarg, "random")) { cfg->victim = VICTIM_RANDOM; break; }
+        goto usage;
+      case 'g':
+        if (!strcmp(optarg, "progress")) { cfg->detector = DET_PROGRESS; break; }
+        if (!strcmp(optarg, "poll")) { cfg->detector = DET_POLL; break; }
+        if (!strcmp(optarg, "block")) { cfg->detector = DET_BLOCK; break; }
+        /* fallthrough */
       default:
+      usage:
         fprintf(stderr,
-          "Uso: %s [-r recursos] [-w workers] [-t timeout_watchdog_s] [-d duracao_s]\n", argv[0]);
+          "Uso: %s [-r recursos] [-w workers] [-t timeout_watchdog_s] [-d duracao_s]\n"
+          "          [-g progress|poll|block] [-p periodo_varredura_ms]\n"
+          "          [-x none|timed|graph] [-l timeout_lock_ms] [-v youngest|fewest|random]\n"
+          "          [-k] [-A] [-n] [-b] [-P] [-c heatmap.csv]\n",
+          argv[0]);
         exit(1);
     }
   }
@@ -60,136 +130,647 @@ static void parse_args(int argc, char**argv, config_t *cfg){
   if (cfg->W < 2) cfg->W = 2;
   if (cfg->watchdog_timeout < 1) cfg->watchdog_timeout = 1;
   if (cfg->duration < 3) cfg->duration = 3;
+  if (cfg->poll_ms < 1) cfg->poll_ms = 1;
+  if (cfg->lock_timeout_ms < 1) cfg->lock_timeout_ms = 1;
+  // a recuperação por grafo precisa de um detector de ciclos
+  if (cfg->recovery == REC_GRAPH && cfg->detector == DET_PROGRESS) cfg->detector = DET_POLL;
+  // sem anotação não há grafo: sobra o watchdog de progresso
+  if (!cfg->annotate){
+    cfg->detector = DET_PROGRESS;
+    cfg->recovery = REC_NONE;
+    cfg->lockdep = 0;
+    cfg->prof = 0;
+  }
+}
+
+// ---------- perfil por lock (-P) ----------
+// Cada thread acumula no próprio buffer, sem atomics; run_phase soma os
+// buffers depois do join. Os baldes são log2 de µs, como em ex9.
+#define PROF_BUCKETS 18   // 0 = <1 µs; b = [2^(b-1), 2^b) µs
+typedef struct {
+  long acq, contended;
+  long long wait_ns, hold_ns;
+  long wait_hist[PROF_BUCKETS], hold_hist[PROF_BUCKETS];
+} lockprof_t;
+
+typedef struct {
+  lockprof_t *lk;       // [R]
+  long long *pair_ns;   // [(R+1)*R]: lock que segurava (linha R = nenhum) × lock pedido
+  long *pair_n;
+  long long *peer_ns;   // [W]: espera desta thread por lock que a thread j segurava
+  long *peer_n;
+  long long t0_a, t0_b; // quando hold_a/hold_b foram pegos
+} prof_buf_t;
+
+static int prof_bucket(long long ns){
+  long long us = ns / 1000;
+  int b = 0;
+  while (us > 0 && b < PROF_BUCKETS - 1) { us >>= 1; b++; }
+  return b;
 }
 
 // ---------- estado por thread (para o relatório do watchdog) ----------
+// Cada thread tem linhas de cache próprias (a struct é alinhada a 64 B, então
+// vizinhas nunca dividem linha). A primeira linha só a dona escreve, com stores
+// relaxed entre os incrementos de um seqlock; o watchdog lê um snapshot
+// consistente de (holds, waiting_for, ops) com st_snapshot, repetindo se pegou
+// uma escrita no meio. O pedido de desistência, escrito pelo detector, fica numa
+// linha à parte para não invalidar a linha quente da dona a cada varredura.
 typedef struct {
+  _Alignas(64) atomic_uint seq; // seqlock: ímpar = escrita em curso
   atomic_int holding_any;     // 1 se segura ao menos 1 lock
   atomic_int hold_a;          // idx do 1º lock segurado (ou -1)
   atomic_int hold_b;          // idx do 2º lock segurado (ou -1)
   atomic_int waiting_for;     // idx do lock que está tentando adquirir (ou -1)
-  atomic_long last_progress_ns; // timestamp do último progresso
+  atomic_long wait_since_ns;  // quando começou a esperar por waiting_for
   atomic_long ops;            // quantas operações concluiu
+  atomic_long attempt_start_ns;   // início da tentativa atual (idade para VICTIM_YOUNGEST)
+  const char *site_a, *site_b;    // lockdep: onde hold_a/hold_b foram pegos
+  // contadores e buffers da dona (frios)
+  long aborts, false_aborts;      // desistências; REC_TIMED: sem ciclo (só contenção)
+  long recoveries;                // desistências que desfizeram um ciclo
+  long long recover_sum_ns, recover_max_ns; // fechamento do ciclo → locks soltos
+  unsigned char *ld_seen;         // lockdep: arestas RxR já vistas por esta thread
+  prof_buf_t *prof;               // -P
+  // escritos pelo detector
+  _Alignas(64) atomic_long abort_req; // vítima: wait_since_ns da espera a desistir (0 = nada)
+  atomic_long cycle_closed_ns;       // fechamento do ciclo que a tornou vítima
 } thread_state_t;
 
+#define ST_GET(st, f)    atomic_load_explicit(&(st)->f, memory_order_relaxed)
+#define ST_SET(st, f, v) atomic_store_explicit(&(st)->f, (v), memory_order_relaxed)
+
+static inline void st_write_begin(thread_state_t *st){
+  unsigned q = atomic_load_explicit(&st->seq, memory_order_relaxed);
+  atomic_store_explicit(&st->seq, q+1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+static inline void st_write_end(thread_state_t *st){
+  unsigned q = atomic_load_explicit(&st->seq, memory_order_relaxed);
+  atomic_store_explicit(&st->seq, q+1, memory_order_release);
+}
+
+typedef struct {
+  int hold_a, hold_b, waiting_for;
+  long long wait_since_ns;
+  long ops;
+} st_snap_t;
+
+static void st_snapshot(thread_state_t *st, st_snap_t *o){
+  for (;;){
+    unsigned q1 = atomic_load_explicit(&st->seq, memory_order_acquire);
+    o->hold_a = ST_GET(st, hold_a);
+    o->hold_b = ST_GET(st, hold_b);
+    o->waiting_for = ST_GET(st, waiting_for);
+    o->wait_since_ns = ST_GET(st, wait_since_ns);
+    o->ops = ST_GET(st, ops);
+    atomic_thread_fence(memory_order_acquire);
+    unsigned q2 = atomic_load_explicit(&st->seq, memory_order_relaxed);
+    if (q1 == q2 && !(q1 & 1)) return;
+    sched_yield();  // dona no meio de uma escrita (talvez preemptada)
+  }
+}
+
 // ---------- contexto da fase ----------
+// Um recurso por linha de cache: o dono fica ao lado do mutex (escritos juntos
+// a cada aquisição) e recursos vizinhos não se invalidam mutuamente.
+typedef struct {
+  _Alignas(64) pthread_mutex_t m;
+  atomic_int owner;       // tid que segura o lock (ou -1): arestas do grafo de espera
+} resource_t;
+
 typedef struct {
   config_t cfg;
-  pthread_mutex_t *locks; // recursos
+  resource_t *res;        // recursos
   pthread_t *threads;
   thread_state_t *states;
-  atomic_long total_ops;
   atomic_int stop;
   int safe_mode; // 0 = inseguro (pode deadlock), 1 = ordenado (evita deadlock)
   pthread_t watchdog_th;
+  atomic_int deadlock;        // 1 depois que um ciclo foi confirmado e reportado
+  long long detect_latency_ns; // detecção - fechamento do ciclo
+  int stuck;                  // workers presos no fim da fase (destacados)
+  atomic_long cycles;         // ciclos confirmados (com recuperação)
+  pthread_mutex_t victim_mtx; // serializa a escolha de vítima (-g block: vários detectores)
+  unsigned victim_seed;       // VICTIM_RANDOM (protegido por victim_mtx)
+  struct ld_edge *ld_edges;   // lockdep: grafo global de ordem, RxR
+  atomic_long ld_new_edges, ld_inversions;
 } phase_t;
 
+// ---------- lockdep: validador de ordem de locks ----------
+// Cada aquisição com locks já seguros gera arestas "segurava A quando pediu B".
+// Se uma aresta nova A→B fecha um caminho B ⇝ A já visto, existe uma ordem em
+// que as threads podem travar, mesmo que o timing nunca tenha travado: avisa na
+// primeira vez, com o local de cada aresta. Caminho rápido: um byte no cache da
+// própria thread (ld_seen); só a primeira vez que a thread vê a aresta toca o
+// grafo global, e só quem instala a aresta procura o caminho inverso.
+#define LD_STR_(x) #x
+#define LD_STR(x) LD_STR_(x)
+#define LOCK_SITE (__FILE__ ":" LD_STR(__LINE__))
+
+struct ld_edge {
+  atomic_int state;   // 0 ausente, 1 sendo gravada, 2 gravada
+  int tid;
+  const char *held_site, *site;  // onde A foi pego e onde B foi pedido
+};
+
+// caminho from ⇝ to no grafo (BFS; R é pequeno); devolve o comprimento e o
+// caminho em path[0..len] (vértices), ou 0 se não existe
+static int ld_path(phase_t *ph, int from, int to, int *path){
+  int R = ph->cfg.R;
+  int prev[R], queue[R], head = 0, tail = 0;
+  for (int i=0;i<R;i++) prev[i] = -2;
+  prev[from] = -1;
+  queue[tail++] = from;
+  while (head < tail){
+    int u = queue[head++];
+    for (int v=0; v<R; v++){
+      if (prev[v] != -2 || !atomic_load_explicit(&ph->ld_edges[u*R+v].state, memory_order_acquire))
+        continue;
+      prev[v] = u;
+      if (v == to){
+        int len = 0;
+        for (int x=v; x!=-1; x=prev[x]) len++;
+        for (int x=v, i=len-1; x!=-1; x=prev[x], i--) path[i] = x;
+        return len - 1;
+      }
+      queue[tail++] = v;
+    }
+  }
+  return 0;
+}
+
+static void ld_slow(phase_t *ph, thread_state_t *st, int tid, int held, const char *held_site,
+                    int rid, const char *site){
+  int R = ph->cfg.R;
+  st->ld_seen[held*R+rid] = 1;
+  struct ld_edge *e = &ph->ld_edges[held*R+rid];
+  int expect = 0;
+  if (!atomic_compare_exchange_strong(&e->state, &expect, 1)) return;  // outra thread já gravou
+  e->tid = tid;
+  e->held_site = held_site;
+  e->site = site;
+  atomic_store_explicit(&e->state, 2, memory_order_release);
+  atomic_fetch_add(&ph->ld_new_edges, 1);
+
+  int path[R+1];
+  int len = ld_path(ph, rid, held, path);
+  if (len == 0) return;
+  atomic_fetch_add(&ph->ld_inversions, 1);
+  fprintf(stderr, "\n[LOCKDEP] Possível deadlock: R%d → R%d inverte a ordem já vista R%d ⇝ R%d\n",
+          held, rid, rid, held);
+  fprintf(stderr, "  T%02d segura R%d (pego em %s) e pede R%d em %s\n", tid, held, held_site, rid, site);
+  for (int i=0;i<len;i++){
+    struct ld_edge *o = &ph->ld_edges[path[i]*R+path[i+1]];
+    while (atomic_load_explicit(&o->state, memory_order_acquire) != 2) ;  // gravação em curso
+    fprintf(stderr, "  T%02d segurou R%d (pego em %s) e pediu R%d em %s\n",
+            o->tid, path[i], o->held_site, path[i+1], o->site);
+  }
+}
+
+static inline void lockdep_acquire(phase_t *ph, thread_state_t *st, int tid, int rid, const char *site){
+  int R = ph->cfg.R;
+  int a = atomic_load_explicit(&st->hold_a, memory_order_relaxed);
+  int b = atomic_load_explicit(&st->hold_b, memory_order_relaxed);
+  if (a >= 0 && !st->ld_seen[a*R+rid]) ld_slow(ph, st, tid, a, st->site_a, rid, site);
+  if (b >= 0 && !st->ld_seen[b*R+rid]) ld_slow(ph, st, tid, b, st->site_b, rid, site);
+}
+
+// custo do caminho rápido (aresta já vista) contra um lock+unlock sem disputa
+static void lockdep_bench(phase_t *ph){
+  const long N = 2000000;
+  int R = ph->cfg.R;
+  thread_state_t bst;
+  memset(&bst, 0, sizeof bst);
+  bst.ld_seen = calloc((size_t)R*R, 1);
+  bst.site_a = "bench";
+  atomic_store(&bst.hold_a, 0);
+  atomic_store(&bst.hold_b, -1);
+  lockdep_acquire(ph, &bst, -1, 1, "bench");  // 0→1 vale nas duas ordens
+  long long t0 = now_ns();
+  for (long i=0;i<N;i++){
+    lockdep_acquire(ph, &bst, -1, 1, "bench");
+    __asm__ __volatile__("" ::: "memory");
+  }
+  long long t1 = now_ns();
+  pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+  for (long i=0;i<N;i++){ pthread_mutex_lock(&m); pthread_mutex_unlock(&m); }
+  long long t2 = now_ns();
+  double hook = (double)(t1-t0)/N, lock = (double)(t2-t1)/N;
+  printf("  lockdep: caminho rapido %.2f ns/aquisicao (lock+unlock sem disputa: %.2f ns → +%.0f%%)\n",
+         hook, lock, lock > 0 ? 100.0*hook/lock : 0.0);
+  free(bst.ld_seen);
+}
+
+// ---------- grafo de espera ----------
+// Aresta t -> u quando t espera pelo lock r e res[r].owner == u. Cada thread espera
+// por no máximo um lock (grau de saída <= 1), então basta seguir a cadeia a
+// partir de s: em até W passos ela termina (sem ciclo) ou repete um vértice.
+// Devolve o tamanho do ciclo alcançável (0 se não há) em cyc[]/via[] (via[i]
+// é o lock pelo qual cyc[i] espera) e since[] com os wait_since_ns.
+static int wfg_cycle(phase_t *ph, int s, int *cyc, int *via, long long *since){
+  int W = ph->cfg.W;
+  int pos[W];
+  for (int i=0;i<W;i++) pos[i] = -1;
+  int n = 0, t = s;
+  while (t >= 0 && pos[t] < 0){
+    st_snap_t sn;
+    st_snapshot(&ph->states[t], &sn);
+    int r = sn.waiting_for;
+    if (r < 0) return 0;
+    pos[t] = n;
+    cyc[n] = t; via[n] = r;
+    since[n] = sn.wait_since_ns;
+    n++;
+    int o = atomic_load_explicit(&ph->res[r].owner, memory_order_acquire);
+    // já é dono e só não limpou waiting_for ainda: não está esperando
+    if (o == t) return 0;
+    t = o;
+  }
+  if (t < 0) return 0;
+  int k = pos[t], len = n - k;
+  memmove(cyc, cyc+k, len*sizeof(int));
+  memmove(via, via+k, len*sizeof(int));
+  memmove(since, since+k, len*sizeof(long long));
+  return len;
+}
+
+// O grafo é lido sem travar nada, então um ciclo pode ser transitório (um dono
+// acabando de soltar). Confirma relendo depois de 100 µs: num deadlock real os
+// mesmos vértices continuam esperando desde os mesmos instantes.
+static int wfg_confirm(phase_t *ph, const int *cyc, const int *via, const long long *since, int n){
+  struct timespec ts = { .tv_sec = 0, .tv_nsec = 100000L };
+  nanosleep(&ts, NULL);
+  int W = ph->cfg.W;
+  int c2[W], v2[W];
+  long long s2[W];
+  if (wfg_cycle(ph, cyc[0], c2, v2, s2) != n) return 0;
+  for (int i=0;i<n;i++)
+    if (c2[i] != cyc[i] || v2[i] != via[i] || s2[i] != since[i]) return 0;
+  return 1;
+}
+
+// reporta o ciclo uma única vez por fase e encerra a fase
+static void report_deadlock(phase_t *ph, const int *cyc, const int *via,
+                            const long long *since, int n, const char *who){
+  long long detect = now_ns();
+  if (atomic_exchange(&ph->deadlock, 1)) return;
+  long long closed = 0;  // o ciclo fechou quando o último membro começou a esperar
+  for (int i=0;i<n;i++) if (since[i] > closed) closed = since[i];
+  ph->detect_latency_ns = detect - closed;
+  fprintf(stderr, "\n[WATCHDOG] Deadlock (ciclo de %d threads, detector=%s, por %s):\n  ",
+          n, detector_names[ph->cfg.detector], who);
+  for (int i=0;i<n;i++) fprintf(stderr, "T%02d -(R%d)-> ", cyc[i], via[i]);
+  fprintf(stderr, "T%02d\n", cyc[0]);
+  fprintf(stderr, "[WATCHDOG] Detectado %.3f ms após o fechamento do ciclo.\n",
+          ph->detect_latency_ns/1e6);
+  atomic_store(&ph->stop, 1);
+}
+
+// REC_GRAPH: escolhe uma vítima no ciclo e pede que desista da espera; ela
+// solta o que segura, recua e tenta de novo, e o ciclo se desfaz.
+// Com -g block vários detectores podem achar o mesmo ciclo ao mesmo tempo:
+// victim_mtx garante uma vítima por ciclo. O pedido é o wait_since_ns da espera
+// a desfazer, não um flag: um pedido que chega depois de a vítima pegar o lock
+// não casa com a próxima espera dela e é descartado.
+static void pick_victim(phase_t *ph, const int *cyc, const long long *since, int n){
+  long long closed = 0;
+  pthread_mutex_lock(&ph->victim_mtx);
+  for (int i=0;i<n;i++){
+    if (since[i] > closed) closed = since[i];
+    // vítima anterior ainda desistindo: o ciclo já vai se desfazer
+    if (atomic_load(&ph->states[cyc[i]].abort_req) == since[i]){
+      pthread_mutex_unlock(&ph->victim_mtx);
+      return;
+    }
+  }
+  int v = 0;
+  for (int i=1;i<n;i++){
+    thread_state_t *a = &ph->states[cyc[i]], *b = &ph->states[cyc[v]];
+    if (ph->cfg.victim == VICTIM_YOUNGEST &&
+        atomic_load(&a->attempt_start_ns) > atomic_load(&b->attempt_start_ns)) v = i;
+    if (ph->cfg.victim == VICTIM_FEWEST && ST_GET(a, ops) < ST_GET(b, ops)) v = i;
+  }
+  if (ph->cfg.victim == VICTIM_RANDOM) v = rand_r(&ph->victim_seed) % n;
+  long c = atomic_fetch_add(&ph->cycles, 1);
+  if (c < 3)
+    fprintf(stderr, "[WATCHDOG] Ciclo de %d threads → vítima T%02d (%s)%s\n", n, cyc[v],
+            victim_names[ph->cfg.victim], c == 2 ? " (próximos ciclos omitidos)" : "");
+  thread_state_t *st = &ph->states[cyc[v]];
+  atomic_store(&st->cycle_closed_ns, closed);
+  // substitui só pedido vencido (ou nenhum); a vítima só zera o campo
+  long cur = atomic_load(&st->abort_req);
+  while (cur != since[v] && !atomic_compare_exchange_weak(&st->abort_req, &cur, since[v])) {}
+  pthread_mutex_unlock(&ph->victim_mtx);
+}
+
+static void on_cycle(phase_t *ph, const int *cyc, const int *via, const long long *since,
+                     int n, const char *who){
+  if (ph->cfg.recovery == REC_GRAPH) pick_victim(ph, cyc, since, n);
+  else if (ph->cfg.recovery == REC_NONE) report_deadlock(ph, cyc, via, since, n, who);
+  // REC_TIMED: o timeout de quem espera desfaz o ciclo
+
+}
+
+// varre o grafo a partir de cada thread; 1 se achou e confirmou um ciclo
+static int wfg_scan(phase_t *ph, const char *who){
+  int W = ph->cfg.W;
+  int cyc[W], via[W];
+  long long since[W];
+  for (int s=0;s<W;s++){
+    int n = wfg_cycle(ph, s, cyc, via, since);
+    if (n > 0 && wfg_confirm(ph, cyc, via, since, n)){
+      on_cycle(ph, cyc, via, since, n, who);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Espera com desistência (recuperação ligada): timedlock em fatias de 1 ms,
+// checando a cada fatia se o detector escolheu esta thread como vítima, se a
+// espera passou de lock_timeout_ms (REC_TIMED) ou se a fase acabou.
+// 0 = adquiriu; -1 = desistiu.
+static int lock_abortable(phase_t *ph, thread_state_t *st, int tid, int rid){
+  long long t0 = ST_GET(st, wait_since_ns);
+  const long long timeout_ns = (long long)ph->cfg.lock_timeout_ms * 1000000LL;
+  for (;;){
+    struct timespec dl;
+    clock_gettime(CLOCK_REALTIME, &dl);  // timedlock usa CLOCK_REALTIME
+    dl.tv_nsec += 1000000L;
+    if (dl.tv_nsec >= 1000000000L){ dl.tv_sec++; dl.tv_nsec -= 1000000000L; }
+    if (pthread_mutex_timedlock(&ph->res[rid].m, &dl) == 0){
+      // o lock veio antes de a vítima ver o pedido: ele já não vale
+      atomic_store(&st->abort_req, 0);
+      atomic_store(&st->cycle_closed_ns, 0);
+      return 0;
+    }
+    // durante esta espera o detector só grava t0 aqui; outro valor é pedido
+    // para uma espera anterior, chegado depois do lock: descarta
+    long req = atomic_load(&st->abort_req);
+    if (req == t0){ atomic_store(&st->abort_req, 0); return -1; }
+    if (req) atomic_compare_exchange_strong(&st->abort_req, &req, 0);
+    if (atomic_load(&ph->stop)) return -1;
+    if (ph->cfg.recovery == REC_TIMED && now_ns() - t0 >= timeout_ns){
+      // estava mesmo num ciclo? senão foi desistência por contenção
+      int W = ph->cfg.W;
+      int cyc[W], via[W];
+      long long since[W];
+      int n = wfg_cycle(ph, tid, cyc, via, since);
+      if (n > 0 && cyc[0] == tid){
+        long long closed = 0;
+        for (int i=0;i<n;i++) if (since[i] > closed) closed = since[i];
+        atomic_store(&st->cycle_closed_ns, closed);
+      } else {
+        atomic_store(&st->cycle_closed_ns, 0);
+        st->false_aborts++;
+      }
+      return -1;
+    }
+  }
+}
+
 // ---------- aquisição anotada (para o watchdog saber intenções) ----------
-static void acquire_lock_annotated(phase_t *ph, int tid, int rid){
+// 0 = adquiriu; -1 = desistiu (só com recuperação ligada)
+// chamada já com o lock, antes de hold_a/hold_b mudarem
+static void prof_acquired(phase_t *ph, thread_state_t *st, int rid, long long wait0, int holder){
+  prof_buf_t *pb = st->prof;
+  lockprof_t *lk = &pb->lk[rid];
+  long long t = now_ns();
+  long long wait = wait0 ? t - wait0 : 0;
+  int held = ST_GET(st, hold_a);
+  lk->acq++;
+  lk->wait_hist[prof_bucket(wait)]++;
+  if (wait0){
+    int row = held < 0 ? ph->cfg.R : held;
+    lk->contended++;
+    lk->wait_ns += wait;
+    pb->pair_ns[row*ph->cfg.R + rid] += wait;
+    pb->pair_n[row*ph->cfg.R + rid]++;
+    if (holder >= 0){ pb->peer_ns[holder] += wait; pb->peer_n[holder]++; }
+  }
+  if (held < 0) pb->t0_a = t; else pb->t0_b = t;
+}
+static void prof_released(thread_state_t *st, int rid, long long t0){
+  lockprof_t *lk = &st->prof->lk[rid];
+  long long hold = now_ns() - t0;
+  lk->hold_ns += hold;
+  lk->hold_hist[prof_bucket(hold)]++;
+}
+
+static int acquire_lock_annotated(phase_t *ph, int tid, int rid, const char *site){
   thread_state_t *st = &ph->states[tid];
-  atomic_store(&st->waiting_for, rid);
-  int rc = pthread_mutex_lock(&ph->locks[rid]);
-  (void)rc;
+  if (!ph->cfg.annotate){
+    pthread_mutex_lock(&ph->res[rid].m);
+    return 0;
+  }
+  if (ph->cfg.lockdep) lockdep_acquire(ph, st, tid, rid, site);
+  // caminho rápido: lock livre não vira aresta de espera nem lê o relógio
+  long long wait0 = 0;
+  int holder = -1;
+  if (pthread_mutex_trylock(&ph->res[rid].m) != 0){
+    wait0 = now_ns();
+    holder = atomic_load_explicit(&ph->res[rid].owner, memory_order_acquire);
+    st_write_begin(st);
+    ST_SET(st, wait_since_ns, wait0);
+    ST_SET(st, waiting_for, rid);
+    st_write_end(st);
+    // DET_BLOCK: vai bloquear → procura um ciclo que passe por esta thread
+    if (ph->cfg.detector == DET_BLOCK && !atomic_load(&ph->deadlock)){
+      // ordena a publicação de waiting_for antes das leituras do grafo
+      // (store→load): duas threads fechando o ciclo juntas não podem ambas
+      // deixar de ver a aresta da outra
+      atomic_thread_fence(memory_order_seq_cst);
+      int W = ph->cfg.W;
+      int cyc[W], via[W];
+      long long since[W];
+      int n = wfg_cycle(ph, tid, cyc, via, since);
+      if (n > 0 && cyc[0] == tid) {
+        if (wfg_confirm(ph, cyc, via, since, n)) on_cycle(ph, cyc, via, since, n, "aquisição");
+      }
+    }
+    if (ph->cfg.recovery == REC_NONE){
+      int rc = pthread_mutex_lock(&ph->res[rid].m);
+      (void)rc;
+    } else if (lock_abortable(ph, st, tid, rid) != 0){
+      st_write_begin(st);
+      ST_SET(st, waiting_for, -1);
+      st_write_end(st);
+      return -1;
+    }
+  }
+  atomic_store_explicit(&ph->res[rid].owner, tid, memory_order_release);
+  if (ph->cfg.prof) prof_acquired(ph, st, rid, wait0, holder);
   // marcar que está segurando
-  if (atomic_load(&st->hold_a) == -1) atomic_store(&st->hold_a, rid);
-  else atomic_store(&st->hold_b, rid);
-  atomic_store(&st->waiting_for, -1);
-  atomic_store(&st->holding_any, 1);
+  st_write_begin(st);
+  if (ST_GET(st, hold_a) == -1){ ST_SET(st, hold_a, rid); st->site_a = site; }
+  else { ST_SET(st, hold_b, rid); st->site_b = site; }
+  ST_SET(st, waiting_for, -1);
+  ST_SET(st, holding_any, 1);
+  st_write_end(st);
+  return 0;
 }
 static void release_lock_annotated(phase_t *ph, int tid, int rid){
-  pthread_mutex_unlock(&ph->locks[rid]);
+  if (!ph->cfg.annotate){
+    pthread_mutex_unlock(&ph->res[rid].m);
+    return;
+  }
+  // antes do unlock: nunca aponta para um ex-dono
+  atomic_store_explicit(&ph->res[rid].owner, -1, memory_order_release);
+  pthread_mutex_unlock(&ph->res[rid].m);
   thread_state_t *st = &ph->states[tid];
-  int a = atomic_load(&st->hold_a);
-  int b = atomic_load(&st->hold_b);
-  if (a == rid) atomic_store(&st->hold_a, -1);
-  if (b == rid) atomic_store(&st->hold_b, -1);
-  int na = atomic_load(&st->hold_a);
-  int nb = atomic_load(&st->hold_b);
-  if (na == -1 && nb == -1) atomic_store(&st->holding_any, 0);
+  int a = ST_GET(st, hold_a), b = ST_GET(st, hold_b);
+  if (ph->cfg.prof) prof_released(st, rid, a == rid ? st->prof->t0_a : st->prof->t0_b);
+  if (a == rid) a = -1;
+  if (b == rid) b = -1;
+  st_write_begin(st);
+  ST_SET(st, hold_a, a);
+  ST_SET(st, hold_b, b);
+  ST_SET(st, holding_any, a != -1 || b != -1);
+  st_write_end(st);
 }
 
 // ---------- worker ----------
+// vítima: solta o que segura (rollback), contabiliza a recuperação e recua
+// por um tempo aleatório com teto exponencial (1, 2, 4, ... 32 ms)
+static void abort_attempt(phase_t *ph, thread_state_t *st, int tid, int held,
+                          int *streak, unsigned *seed){
+  if (held >= 0) release_lock_annotated(ph, tid, held);
+  if (atomic_load(&ph->stop)) return;  // fim da fase, não é desistência
+  st->aborts++;
+  long long closed = atomic_load(&st->cycle_closed_ns);
+  if (closed > 0){
+    long long rec = now_ns() - closed;
+    st->recoveries++;
+    st->recover_sum_ns += rec;
+    if (rec > st->recover_max_ns) st->recover_max_ns = rec;
+    atomic_store(&st->cycle_closed_ns, 0);
+  }
+  int cap = 1 << (*streak < 5 ? *streak : 5);
+  if (*streak < 5) (*streak)++;
+  sleep_ms(1 + rand_r(seed) % cap);
+}
+
+// trabalho simulado (desligado com -n)
+static inline void work_ms(phase_t *ph, int ms){
+  if (!ph->cfg.no_sleep) sleep_ms(ms);
+}
+
 static void *worker(void *arg){
   long tid = (long)arg;
   extern phase_t g_phase;
   phase_t *ph = &g_phase;
   thread_state_t *st = &ph->states[tid];
   unsigned seed = (unsigned)(time(NULL) ^ (tid*2654435761u));
-  int R = ph->cfg.R;
+  int ring = ph->cfg.W < ph->cfg.R ? ph->cfg.W : ph->cfg.R;
+  int streak = 0;  // desistências seguidas (teto do recuo)
 
   while (!atomic_load(&ph->stop)){
-    // Escolher dois recursos (formar conflitos intencionais).
-    int a = (int)(tid % R);
-    int b = (int)((tid+1) % R);
-
-    int first = a, second = b;
-    if (!ph->safe_mode){
-      // Modo inseguro: às vezes invertemos a ordem para criar espera circular.
-      int invert = ((tid % 2)==1); // ímpares bloqueiam na ordem oposta
-      if (invert){ first = b; second = a; }
-    } else {
-      // Modo seguro: sempre menor -> maior (ordem total)
-      if (second < first){ int t=first; first=second; second=t; }
-    }
+    // Escolher dois recursos (formar conflitos intencionais): cada thread pega
+    // (tid, tid+1) módulo ring = min(W, R), nessa ordem. A thread ring-1 fecha o
+    // anel (ring-1 → 0), então no modo inseguro todas segurando o primeiro formam
+    // espera circular mesmo com W < R (com módulo R o anel nunca fecharia).
+    // (Inverter a ordem das ímpares, como antes, quebrava o anel: nunca travava.)
+    int first = (int)(tid % ring);
+    int second = (int)((tid+1) % ring);
+    // Modo seguro: sempre menor -> maior (ordem total)
+    if (ph->safe_mode && second < first){ int t=first; first=second; second=t; }
 
     // trabalho antes do lock
-    sleep_ms(1 + (rand_r(&seed)%3)); // jitter leve
+    work_ms(ph, 1 + (rand_r(&seed)%3)); // jitter leve
 
     // pegar locks na ordem definida
-    acquire_lock_annotated(ph, (int)tid, first);
-    sleep_ms(1 + (rand_r(&seed)%2)); // aumentar janela de interleaving
-    acquire_lock_annotated(ph, (int)tid, second);
+    if (ph->cfg.recovery != REC_NONE) atomic_store(&st->attempt_start_ns, now_ns());
+    if (acquire_lock_annotated(ph, (int)tid, first, LOCK_SITE) != 0){
+      abort_attempt(ph, st, (int)tid, -1, &streak, &seed);
+      continue;
+    }
+    work_ms(ph, 1 + (rand_r(&seed)%2)); // aumentar janela de interleaving
+    if (acquire_lock_annotated(ph, (int)tid, second, LOCK_SITE) != 0){
+      abort_attempt(ph, st, (int)tid, first, &streak, &seed);
+      continue;
+    }
+    streak = 0;
 
     // seção crítica simulada
-    sleep_ms(1 + (rand_r(&seed)%2));
+    work_ms(ph, 1 + (rand_r(&seed)%2));
 
-    // progresso
-    atomic_fetch_add(&ph->total_ops, 1);
-    atomic_fetch_add(&st->ops, 1);
-    atomic_store(&st->last_progress_ns, now_ns());
+    // progresso (contador por thread; o watchdog soma)
+    if (ph->cfg.annotate){
+      st_write_begin(st);
+      ST_SET(st, ops, ST_GET(st, ops) + 1);
+      st_write_end(st);
+    } else {
+      ST_SET(st, ops, ST_GET(st, ops) + 1);
+    }
 
     // soltar
     release_lock_annotated(ph, (int)tid, second);
     release_lock_annotated(ph, (int)tid, first);
 
     // descanso
-    sleep_ms(1 + (rand_r(&seed)%2));
+    work_ms(ph, 1 + (rand_r(&seed)%2));
   }
 
   return NULL;
 }
 
 // ---------- watchdog ----------
+static long long total_ops(phase_t *ph){
+  long long sum = 0;
+  for (int i=0;i<ph->cfg.W;i++) sum += ST_GET(&ph->states[i], ops);
+  return sum;
+}
+
 static void *watchdog(void *arg){
   (void)arg;
   extern phase_t g_phase;
   phase_t *ph = &g_phase;
-  long long last_ops = atomic_load(&ph->total_ops);
+  long long last_ops = total_ops(ph);
   long long last_change = now_ns();
   const long long timeout_ns = (long long)ph->cfg.watchdog_timeout * 1000000000LL;
+  const int poll_ms = ph->cfg.detector == DET_POLL ? ph->cfg.poll_ms : 200;
+  // último progresso de cada thread, do ponto de vista do watchdog
+  // (os workers não leem o relógio a cada operação)
+  long long seen_ops[ph->cfg.W], seen_at[ph->cfg.W];
+  for (int i=0;i<ph->cfg.W;i++){ seen_ops[i] = 0; seen_at[i] = last_change; }
 
   while (!atomic_load(&ph->stop)){
-    sleep_ms(200);
-    long long cur_ops = atomic_load(&ph->total_ops);
+    sleep_ms(poll_ms);
+    if (ph->cfg.detector == DET_POLL && ph->cfg.recovery != REC_TIMED &&
+        wfg_scan(ph, "varredura") && ph->cfg.recovery == REC_NONE) break;
+    long long cur_ops = 0, tick = now_ns();
+    for (int i=0;i<ph->cfg.W;i++){
+      long o = ST_GET(&ph->states[i], ops);
+      if (o != seen_ops[i]){ seen_ops[i] = o; seen_at[i] = tick; }
+      cur_ops += o;
+    }
     if (cur_ops != last_ops){
       last_ops = cur_ops;
       last_change = now_ns();
       continue;
     }
     long long idle = now_ns() - last_change;
+    if (idle >= timeout_ns && ph->cfg.detector != DET_PROGRESS){
+      // sem ciclo no grafo: não é deadlock; uma varredura final tira a dúvida
+      int found = wfg_scan(ph, "timeout");
+      if (found && ph->cfg.recovery == REC_NONE) break;
+      if (!found)
+        fprintf(stderr, "\n[WATCHDOG] Sem progresso por %d s e sem ciclo no grafo de espera:"
+                " livelock ou trabalho lento, não deadlock.\n", ph->cfg.watchdog_timeout);
+      last_change = now_ns();
+      continue;
+    }
     if (idle >= timeout_ns){
       // Sem progresso por T s → suspeita de deadlock
       fprintf(stderr, "\n[WATCHDOG] Sem progresso por %d s. Possível deadlock.\n", ph->cfg.watchdog_timeout);
       fprintf(stderr, "[WATCHDOG] Snapshot de estados (tid: hold_a,hold_b | esperando):\n");
       for (int i=0;i<ph->cfg.W;i++){
-        thread_state_t *st = &ph->states[i];
-        int ha = atomic_load(&st->hold_a);
-        int hb = atomic_load(&st->hold_b);
-        int wf = atomic_load(&st->waiting_for);
-        long long lp = atomic_load(&st->last_progress_ns);
-        double secs = (now_ns()-lp)/1e9;
+        st_snap_t sn;
+        st_snapshot(&ph->states[i], &sn);
+        double secs = (now_ns()-seen_at[i])/1e9;
         fprintf(stderr, "  T%02d: hold=(%d,%d) wait=%d last_prog=%.2fs ops=%ld\n",
-                i, ha, hb, wf, secs, (long)atomic_load(&st->ops));
+                i, sn.hold_a, sn.hold_b, sn.waiting_for, secs, sn.ops);
       }
       // encerra fase
       atomic_store(&ph->stop, 1);
@@ -207,37 +788,195 @@ static void phase_init(phase_t *ph, config_t cfg, int safe_mode){
   memset(ph, 0, sizeof(*ph));
   ph->cfg = cfg;
   ph->safe_mode = safe_mode;
-  ph->locks = calloc(cfg.R, sizeof(pthread_mutex_t));
+  ph->res = aligned_alloc(64, cfg.R * sizeof(resource_t));
   ph->threads = calloc(cfg.W, sizeof(pthread_t));
-  ph->states = calloc(cfg.W, sizeof(thread_state_t));
-  atomic_store(&ph->total_ops, 0);
+  ph->states = aligned_alloc(64, cfg.W * sizeof(thread_state_t));
+  memset(ph->states, 0, cfg.W * sizeof(thread_state_t));
+  if (cfg.lockdep){
+    ph->ld_edges = calloc((size_t)cfg.R*cfg.R, sizeof(struct ld_edge));
+    for (int i=0;i<cfg.W;i++) ph->states[i].ld_seen = calloc((size_t)cfg.R*cfg.R, 1);
+  }
+  if (cfg.prof){
+    for (int i=0;i<cfg.W;i++){
+      prof_buf_t *pb = calloc(1, sizeof *pb);
+      pb->lk = calloc(cfg.R, sizeof *pb->lk);
+      pb->pair_ns = calloc((size_t)(cfg.R+1)*cfg.R, sizeof *pb->pair_ns);
+      pb->pair_n = calloc((size_t)(cfg.R+1)*cfg.R, sizeof *pb->pair_n);
+      pb->peer_ns = calloc(cfg.W, sizeof *pb->peer_ns);
+      pb->peer_n = calloc(cfg.W, sizeof *pb->peer_n);
+      ph->states[i].prof = pb;
+    }
+  }
   atomic_store(&ph->stop, 0);
+  ph->victim_seed = (unsigned)time(NULL);
+  pthread_mutex_init(&ph->victim_mtx, NULL);
   for (int i=0;i<cfg.R;i++){
-    pthread_mutex_init(&ph->locks[i], NULL);
+    pthread_mutex_init(&ph->res[i].m, NULL);
+    atomic_store(&ph->res[i].owner, -1);
   }
   for (int i=0;i<cfg.W;i++){
     atomic_store(&ph->states[i].holding_any, 0);
     atomic_store(&ph->states[i].hold_a, -1);
     atomic_store(&ph->states[i].hold_b, -1);
     atomic_store(&ph->states[i].waiting_for, -1);
-    atomic_store(&ph->states[i].last_progress_ns, now_ns());
+    atomic_store(&ph->states[i].wait_since_ns, 0);
     atomic_store(&ph->states[i].ops, 0);
   }
 }
 static void phase_destroy(phase_t *ph){
+  free(ph->threads); ph->threads=NULL;
+  if (ph->stuck){
+    // workers presos seguem bloqueados nestes mutexes: não dá para destruí-los
+    // nem liberar o estado que eles ainda referenciam; a fase vaza de propósito.
+    ph->res=NULL; ph->states=NULL; ph->ld_edges=NULL;
+    return;
+  }
   for (int i=0;i<ph->cfg.R;i++){
-    pthread_mutex_destroy(&ph->locks[i]);
+    pthread_mutex_destroy(&ph->res[i].m);
   }
-  free(ph->locks); ph->locks=NULL;
-  free(ph->threads); ph->threads=NULL;
+  pthread_mutex_destroy(&ph->victim_mtx);
+  free(ph->res); ph->res=NULL;
+  for (int i=0;i<ph->cfg.W;i++){
+    thread_state_t *st = &ph->states[i];
+    free(st->ld_seen);
+    if (st->prof){
+      free(st->prof->lk); free(st->prof->pair_ns); free(st->prof->pair_n);
+      free(st->prof->peer_ns); free(st->prof->peer_n); free(st->prof);
+    }
+  }
+  free(ph->ld_edges); ph->ld_edges=NULL;
   free(ph->states); ph->states=NULL;
 }
 
+// ---------- relatório do perfil por lock ----------
+static FILE *prof_csv_out;  // aberto em main com -c
+
+// limite superior (µs) do balde onde cai o quantil q
+static long prof_pct(const long *hist, long n, double q){
+  long need = (long)(q*n + 0.5), cum = 0;
+  if (need < 1) need = 1;
+  for (int b=0;b<PROF_BUCKETS;b++){
+    cum += hist[b];
+    if (cum >= need) return 1L << b;
+  }
+  return 1L << (PROF_BUCKETS-1);
+}
+
+typedef struct { int from, to; long n; long long ns; } prof_pair_t;
+
+static int cmp_pair_desc(const void *x, const void *y){
+  long long a = ((const prof_pair_t*)x)->ns, b = ((const prof_pair_t*)y)->ns;
+  return (a < b) - (a > b);
+}
+
+static void prof_print_top(const char *title, prof_pair_t *pairs, int n, int is_lock, int R){
+  qsort(pairs, n, sizeof *pairs, cmp_pair_desc);
+  printf("  %s:", title);
+  int shown = 0;
+  for (int i=0;i<n && shown<5;i++){
+    if (!pairs[i].n) break;
+    if (is_lock && pairs[i].from == R) printf("%s —→R%d", shown ? "," : "", pairs[i].to);
+    else printf("%s %s%d→%s%d", shown ? "," : "", is_lock ? "R" : "T", pairs[i].from,
+                is_lock ? "R" : "T", pairs[i].to);
+    printf(" %ld× %.2f ms", pairs[i].n, pairs[i].ns/1e6);
+    shown++;
+  }
+  printf("%s\n", shown ? "" : " sem disputa");
+}
+
+// Soma os buffers das threads: por lock, aquisições, % disputadas e os
+// histogramas de espera e de posse; depois os pares que mais custaram espera.
+static void prof_report(phase_t *ph){
+  int R = ph->cfg.R, W = ph->cfg.W;
+  lockprof_t *lk = calloc(R, sizeof *lk);
+  long long *pair_ns = calloc((size_t)(R+1)*R, sizeof *pair_ns);
+  long *pair_n = calloc((size_t)(R+1)*R, sizeof *pair_n);
+  prof_pair_t *pairs = calloc((size_t)(R+1)*R + (size_t)W*W, sizeof *pairs);
+  if (!lk || !pair_ns || !pair_n || !pairs){
+    free(lk); free(pair_ns); free(pair_n); free(pairs);
+    return;
+  }
+  int np = 0;
+  for (int i=0;i<W;i++){
+    prof_buf_t *pb = ph->states[i].prof;
+    for (int r=0;r<R;r++){
+      lk[r].acq += pb->lk[r].acq;
+      lk[r].contended += pb->lk[r].contended;
+      lk[r].wait_ns += pb->lk[r].wait_ns;
+      lk[r].hold_ns += pb->lk[r].hold_ns;
+      for (int b=0;b<PROF_BUCKETS;b++){
+        lk[r].wait_hist[b] += pb->lk[r].wait_hist[b];
+        lk[r].hold_hist[b] += pb->lk[r].hold_hist[b];
+      }
+    }
+    for (int k=0;k<(R+1)*R;k++){ pair_ns[k] += pb->pair_ns[k]; pair_n[k] += pb->pair_n[k]; }
+  }
+
+  // só as colunas do histograma com alguma contagem
+  int bmin = PROF_BUCKETS, bmax = -1;
+  for (int r=0;r<R;r++)
+    for (int b=0;b<PROF_BUCKETS;b++)
+      if (lk[r].wait_hist[b] || lk[r].hold_hist[b]){ if (b < bmin) bmin = b; if (b > bmax) bmax = b; }
+  printf("  perfil por lock (µs; p50/p99 = limite do balde):\n");
+  printf("  %-4s %9s %7s %9s %7s %7s %9s %7s %7s  baldes (µs <)\n",
+         "lock", "aquis", "disp%", "esp med", "p50", "p99", "posse med", "p50", "p99");
+  for (int r=0;r<R;r++){
+    long hold_n = 0;
+    for (int b=0;b<PROF_BUCKETS;b++) hold_n += lk[r].hold_hist[b];
+    printf("  R%-3d %9ld %6.1f%% %9.1f %7ld %7ld %9.1f %7ld %7ld  esp ", r, lk[r].acq,
+           lk[r].acq ? 100.0*lk[r].contended/lk[r].acq : 0.0,
+           lk[r].acq ? lk[r].wait_ns/1e3/lk[r].acq : 0.0,
+           lk[r].acq ? prof_pct(lk[r].wait_hist, lk[r].acq, 0.50) : 0,
+           lk[r].acq ? prof_pct(lk[r].wait_hist, lk[r].acq, 0.99) : 0,
+           hold_n ? lk[r].hold_ns/1e3/hold_n : 0.0,
+           hold_n ? prof_pct(lk[r].hold_hist, hold_n, 0.50) : 0,
+           hold_n ? prof_pct(lk[r].hold_hist, hold_n, 0.99) : 0);
+    for (int b=bmin;b<=bmax;b++) printf(" %6ld", lk[r].wait_hist[b]);
+    printf("\n  %-4s %9s %7s %9s %7s %7s %9s %7s %7s  pos ", "", "", "", "", "", "", "", "", "");
+    for (int b=bmin;b<=bmax;b++) printf(" %6ld", lk[r].hold_hist[b]);
+    printf("\n");
+  }
+  if (bmax >= 0){
+    printf("  %-4s %9s %7s %9s %7s %7s %9s %7s %7s  µs< ", "", "", "", "", "", "", "", "", "");
+    for (int b=bmin;b<=bmax;b++) printf(" %6ld", 1L << b);
+    printf("\n");
+  }
+
+  for (int k=0;k<(R+1)*R;k++)
+    pairs[np++] = (prof_pair_t){ k / R, k % R, pair_n[k], pair_ns[k] };
+  prof_print_top("espera por par segurava→pediu (— = nenhum)", pairs, np, 1, R);
+  np = 0;
+  for (int i=0;i<W;i++)
+    for (int j=0;j<W;j++)
+      pairs[np++] = (prof_pair_t){ j, i, ph->states[i].prof->peer_n[j], ph->states[i].prof->peer_ns[j] };
+  prof_print_top("espera por par dono→esperando", pairs, np, 0, R);
+
+  // mapa de calor: linha = lock que segurava, coluna = lock pedido, célula = espera total (µs)
+  if (prof_csv_out){
+    const char *fase = ph->safe_mode ? "segura" : "insegura";
+    if (ftell(prof_csv_out) == 0){
+      fprintf(prof_csv_out, "fase,segurava");
+      for (int r=0;r<R;r++) fprintf(prof_csv_out, ",R%d", r);
+      fprintf(prof_csv_out, "\n");
+    }
+    for (int h=0;h<=R;h++){
+      if (h == R) fprintf(prof_csv_out, "%s,nenhum", fase);
+      else fprintf(prof_csv_out, "%s,R%d", fase, h);
+      for (int r=0;r<R;r++) fprintf(prof_csv_out, ",%.1f", pair_ns[h*R + r]/1e3);
+      fprintf(prof_csv_out, "\n");
+    }
+    fflush(prof_csv_out);
+  }
+  free(lk); free(pair_ns); free(pair_n); free(pairs);
+}
+
 // ---------- executar uma fase ----------
-static void run_phase(const char *label){
+// retorna ops/s da fase
+static double run_phase(const char *label){
   phase_t *ph = &g_phase;
-  printf("=== %s === (R=%d, W=%d, watchdog=%ds, duracao=%ds)\n",
-         label, ph->cfg.R, ph->cfg.W, ph->cfg.watchdog_timeout, ph->cfg.duration);
+  printf("=== %s === (R=%d, W=%d, watchdog=%ds, duracao=%ds, detector=%s, recuperacao=%s)\n",
+         label, ph->cfg.R, ph->cfg.W, ph->cfg.watchdog_timeout, ph->cfg.duration,
+         detector_names[ph->cfg.detector], recovery_names[ph->cfg.recovery]);
 
   // spawn workers
   for (long i=0;i<ph->cfg.W;i++){
@@ -253,30 +992,117 @@ static void run_phase(const char *label){
   }
   atomic_store(&ph->stop, 1);
 
-  // join
-  for (int i=0;i<ph->cfg.W;i++) pthread_join(ph->threads[i], NULL);
+  long long t1 = now_ns();
+
+  // join; quem não sai em 500 ms está preso num lock do ciclo e é destacado
   pthread_join(ph->watchdog_th, NULL);
+  struct timespec dl;
+  clock_gettime(CLOCK_REALTIME, &dl);
+  dl.tv_nsec += 500000000L;
+  if (dl.tv_nsec >= 1000000000L){ dl.tv_sec++; dl.tv_nsec -= 1000000000L; }
+  for (int i=0;i<ph->cfg.W;i++){
+    if (pthread_timedjoin_np(ph->threads[i], NULL, &dl) != 0){
+      pthread_detach(ph->threads[i]);
+      ph->stuck++;
+    }
+  }
 
-  long long ops = atomic_load(&ph->total_ops);
-  double elapsed = (now_ns()-t0)/1e9;
+  long long ops = total_ops(ph);
+  double elapsed = (t1-t0)/1e9;
   double ops_s = (elapsed>0)? ops/elapsed : 0.0;
-  printf("%s: ops=%lld em %.2fs (%.1f ops/s)\n\n", label, ops, elapsed, ops_s);
+  printf("%s: ops=%lld em %.2fs (%.1f ops/s)\n", label, ops, elapsed, ops_s);
+  if (atomic_load(&ph->deadlock))
+    printf("  deadlock detectado em %.3f ms após o fechamento do ciclo\n", ph->detect_latency_ns/1e6);
+  if (ph->stuck) printf("  %d worker(s) presos e destacados\n", ph->stuck);
+  if (ph->cfg.lockdep){
+    printf("  lockdep: %ld arestas de ordem, %ld inversoes\n",
+           (long)atomic_load(&ph->ld_new_edges), (long)atomic_load(&ph->ld_inversions));
+    lockdep_bench(ph);
+  }
+  if (ph->cfg.recovery != REC_NONE){
+    long aborts = 0, false_aborts = 0, recs = 0;
+    long long rec_sum = 0, rec_max = 0;
+    for (int i=0;i<ph->cfg.W;i++){
+      thread_state_t *st = &ph->states[i];
+      aborts += st->aborts;
+      false_aborts += st->false_aborts;
+      recs += st->recoveries;
+      rec_sum += st->recover_sum_ns;
+      if (st->recover_max_ns > rec_max) rec_max = st->recover_max_ns;
+    }
+    long tries = (long)ops + aborts;
+    printf("  recuperacao: abortos=%ld (%.2f%% das tentativas, %ld sem ciclo)", aborts,
+           tries ? 100.0*aborts/tries : 0.0, false_aborts);
+    if (ph->cfg.recovery == REC_GRAPH)
+      printf(" ciclos=%ld vitima=%s", (long)atomic_load(&ph->cycles), victim_names[ph->cfg.victim]);
+    printf("\n  latencia de recuperacao (ciclo fechado → locks soltos): ");
+    if (recs) printf("media=%.2f ms max=%.2f ms (%ld)\n", rec_sum/1e6/recs, rec_max/1e6, recs);
+    else printf("sem ciclos\n");
+  }
+  if (ph->cfg.prof) prof_report(ph);
+  printf("\n");
+  return ops_s;
 }
 
 // ---------- main: roda Fase A (insegura) e Fase B (ordenada) ----------
 int main(int argc, char **argv){
   config_t cfg; parse_args(argc, argv, &cfg);
+  if (cfg.prof_csv && !(prof_csv_out = fopen(cfg.prof_csv, "w"))){
+    perror(cfg.prof_csv);
+    return 1;
+  }
+
+  // -b: só a fase segura, sem sleeps, com e sem o estado para o watchdog
+  if (cfg.bench){
+    // as duas primeiras rodadas usam o mesmo watchdog de progresso (sem varrer
+    // o grafo), então a diferença é só o custo da anotação; o detector pedido
+    // (-g) roda numa terceira, com o custo dele reportado à parte.
+    config_t on = cfg, off = cfg, det = cfg;
+    on.no_sleep = off.no_sleep = det.no_sleep = 1;
+    on.detector = off.detector = DET_PROGRESS;
+    on.recovery = off.recovery = REC_NONE;
+    on.lockdep = off.lockdep = det.lockdep = 0;
+    on.prof = off.prof = det.prof = 0;
+    off.annotate = 0;
+    phase_init(&g_phase, on, /*safe_mode=*/1);
+    double ops_on = run_phase("BENCH com anotacao (seqlock por thread)");
+    phase_destroy(&g_phase);
+    phase_init(&g_phase, off, /*safe_mode=*/1);
+    double ops_off = run_phase("BENCH sem anotacao (locks crus)");
+    phase_destroy(&g_phase);
+    if (ops_off > 0)
+      printf("Anotacao: %.1f%% da vazao sem anotacao (%.1f ns/op a mais)\n",
+             100.0*ops_on/ops_off,
+             ops_on > 0 ? 1e9/ops_on - 1e9/ops_off : 0.0);
+    if (det.detector != DET_PROGRESS && det.annotate){
+      putchar('\n');
+      phase_init(&g_phase, det, /*safe_mode=*/1);
+      double ops_det = run_phase(det.detector == DET_POLL ? "BENCH com anotacao + detector poll"
+                                                    : "BENCH com anotacao + detector block");
+      phase_destroy(&g_phase);
+      if (ops_on > 0)
+        printf("Detector: %.1f%% da vazao so com anotacao (%.1f ns/op a mais)\n",
+               100.0*ops_det/ops_on,
+               ops_det > 0 ? 1e9/ops_det - 1e9/ops_on : 0.0);
+    }
+    return 0;
+  }
 
   // Fase A: insegura (propensa a deadlock)
+  // (com -x timed|graph, a vítima de cada ciclo recua e a fase segue até o fim)
   phase_init(&g_phase, cfg, /*safe_mode=*/0);
-  run_phase("FASE A (insegura: ordem variável de locks)"); // watchdog pode interromper
+  double ops_a = run_phase("FASE A (insegura: ordem circular de locks)"); // watchdog pode interromper
   phase_destroy(&g_phase);
 
   // Fase B: segura (ordem total)
   phase_init(&g_phase, cfg, /*safe_mode=*/1);
-  run_phase("FASE B (segura: ordem total de travamento)");
+  double ops_b = run_phase("FASE B (segura: ordem total de travamento)");
   phase_destroy(&g_phase);
 
+  if (cfg.recovery != REC_NONE && ops_b > 0)
+    printf("Vazao A/B com recuperacao %s: %.1f%% da fase ordenada\n",
+           recovery_names[cfg.recovery], 100.0*ops_a/ops_b);
+
   printf("Concluído.\n");
   return 0;
 }
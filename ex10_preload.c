@@ -0,0 +1,542 @@
+// ex10_preload.c
+// Watchdog de deadlock da Questão 10 como biblioteca LD_PRELOAD: intercepta
+// pthread_mutex_lock/trylock/timedlock/clocklock/unlock (e pthread_cond_wait/timedwait/
+// clockwait, que soltam e repegam o mutex) de qualquer programa, anota o que
+// cada thread segura e pelo que espera e roda o detector de ciclos numa thread
+// de fundo, sem recompilar o programa.
+// Compile: gcc -O2 -shared -fPIC -pthread ex10_preload.c -o libwatchdog.so -ldl
+// Execute: LD_PRELOAD=./libwatchdog.so ./ex10 -A
+// Opcional: WATCHDOG_PERIOD_MS=100 WATCHDOG_STALL_MS=3000 WATCHDOG_ABORT=1 WATCHDOG_LOG=arq
+//           WATCHDOG_SUMMARY=1 (resumo ao sair mesmo sem deadlock nem espera longa)
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WD_MAX_THREADS 1024  // threads anotadas ao mesmo tempo (as demais passam direto)
+#define WD_MAX_HOLDS   16    // locks segurados por thread que entram no grafo
+#define WD_TLS __attribute__((tls_model("initial-exec")))
+
+static inline long long now_ns(void){
+  struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+// ---------- funções reais ----------
+typedef int (*lock_fn)(pthread_mutex_t *);
+typedef int (*timedlock_fn)(pthread_mutex_t *, const struct timespec *);
+typedef int (*clocklock_fn)(pthread_mutex_t *, clockid_t, const struct timespec *);
+typedef int (*condwait_fn)(pthread_cond_t *, pthread_mutex_t *);
+typedef int (*condtimedwait_fn)(pthread_cond_t *, pthread_mutex_t *, const struct timespec *);
+typedef int (*condclockwait_fn)(pthread_cond_t *, pthread_mutex_t *, clockid_t, const struct timespec *);
+static lock_fn real_lock, real_trylock, real_unlock;
+static timedlock_fn real_timedlock;
+static clocklock_fn real_clocklock;       // NULL na glibc < 2.30
+static condwait_fn real_cond_wait;
+static condtimedwait_fn real_cond_timedwait;
+static condclockwait_fn real_cond_clockwait; // NULL na glibc < 2.30
+
+static __thread int resolving WD_TLS;
+
+static void wd_die(const char *what, const char *name){
+  // sem stdio nem mutex: ainda não há como travar nada com segurança
+  if (write(STDERR_FILENO, "[watchdog] ", 11) < 0 ||
+      write(STDERR_FILENO, what, strlen(what)) < 0 ||
+      write(STDERR_FILENO, name, strlen(name)) < 0 ||
+      write(STDERR_FILENO, "\n", 1) < 0) {}
+  abort();
+}
+
+// required = 0: a função pode não existir nesta glibc (devolve NULL)
+static void *wd_sym(const char *name, const char *version, int required){
+  // pthread_cond_* tem duas versões na glibc; dlsym pode devolver a antiga
+  void *f = version ? dlvsym(RTLD_NEXT, name, version) : NULL;
+  if (!f) f = dlsym(RTLD_NEXT, name);
+  if (!f && required) wd_die("função real não encontrada: ", name);
+  return f;
+}
+
+// O dlsym não trava pthread_mutex_t (o loader usa locks internos), então não
+// há reentrada aqui; se houver, é melhor parar do que chamar um ponteiro nulo.
+static void wd_resolve(void){
+  if (resolving) wd_die("reentrada durante dlsym em ", "pthread_mutex_*");
+  resolving = 1;
+  real_trylock = (lock_fn)wd_sym("pthread_mutex_trylock", NULL, 1);
+  real_unlock = (lock_fn)wd_sym("pthread_mutex_unlock", NULL, 1);
+  real_timedlock = (timedlock_fn)wd_sym("pthread_mutex_timedlock", NULL, 1);
+  real_cond_wait = (condwait_fn)wd_sym("pthread_cond_wait", "GLIBC_2.3.2", 1);
+  real_cond_timedwait = (condtimedwait_fn)wd_sym("pthread_cond_timedwait", "GLIBC_2.3.2", 1);
+  // *_clock* entraram na glibc 2.30: sem elas, só não há o que repassar
+  real_clocklock = (clocklock_fn)wd_sym("pthread_mutex_clocklock", "GLIBC_2.30", 0);
+  real_cond_clockwait = (condclockwait_fn)wd_sym("pthread_cond_clockwait", "GLIBC_2.30", 0);
+  real_lock = (lock_fn)wd_sym("pthread_mutex_lock", NULL, 1);  // por último: é o que indica "resolvido"
+  resolving = 0;
+}
+
+// ---------- estado por thread ----------
+// Mesmo desenho de ex10.c: cada vaga ocupa linhas de cache próprias (~5, por
+// causa das pilhas de 16 holds), escritas só pela dona com stores relaxed dentro
+// de um seqlock; o detector lê snapshots. O que muda a cada lock (seq, nheld,
+// contadores, primeiros holds) fica na primeira linha; o campo que o detector
+// escreve fica numa linha à parte.
+typedef struct {
+  _Alignas(64) atomic_uint seq;     // seqlock: ímpar = escrita em curso
+  atomic_int used;                  // vaga ocupada por uma thread viva
+  atomic_int tid;
+  atomic_int nheld;
+  atomic_long acq, contended;       // só a dona incrementa
+  atomic_uintptr_t waiting_for;     // mutex pelo qual espera (0 = nenhum)
+  atomic_uintptr_t wait_pc;         // de onde pediu
+  atomic_llong wait_since_ns;
+  atomic_uintptr_t held[WD_MAX_HOLDS];
+  atomic_uintptr_t held_pc[WD_MAX_HOLDS];
+  _Alignas(64) long long reported_since; // só o detector: espera já reportada
+} wd_slot_t;
+
+#define ST_GET(st, f)    atomic_load_explicit(&(st)->f, memory_order_relaxed)
+#define ST_SET(st, f, v) atomic_store_explicit(&(st)->f, (v), memory_order_relaxed)
+
+static wd_slot_t slots[WD_MAX_THREADS];
+static atomic_int slots_top;            // maior vaga já usada + 1
+static atomic_long done_acq, done_contended; // de threads que já saíram
+static pthread_key_t wd_key;
+static int wd_key_ok;
+static __thread wd_slot_t *self WD_TLS;
+static __thread int bypass WD_TLS;      // detector, threads saindo ou sem vaga
+
+static inline void st_write_begin(wd_slot_t *st){
+  unsigned q = atomic_load_explicit(&st->seq, memory_order_relaxed);
+  atomic_store_explicit(&st->seq, q+1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+static inline void st_write_end(wd_slot_t *st){
+  unsigned q = atomic_load_explicit(&st->seq, memory_order_relaxed);
+  atomic_store_explicit(&st->seq, q+1, memory_order_release);
+}
+
+static void wd_thread_exit(void *p){
+  wd_slot_t *st = p;
+  st_write_begin(st);
+  ST_SET(st, nheld, 0);
+  ST_SET(st, waiting_for, 0);
+  st_write_end(st);
+  atomic_fetch_add(&done_acq, ST_GET(st, acq));
+  atomic_fetch_add(&done_contended, ST_GET(st, contended));
+  self = NULL;
+  bypass = 1;  // destrutores seguintes ainda podem travar mutexes
+  atomic_store_explicit(&st->used, 0, memory_order_release);
+}
+
+static wd_slot_t *wd_self(void){
+  if (self) return self;
+  if (bypass) return NULL;
+  for (int i=0;i<WD_MAX_THREADS;i++){
+    int free_slot = 0;
+    if (!atomic_compare_exchange_strong(&slots[i].used, &free_slot, 1)) continue;
+    wd_slot_t *st = &slots[i];
+    st_write_begin(st);
+    ST_SET(st, tid, (int)syscall(SYS_gettid));
+    ST_SET(st, nheld, 0);
+    ST_SET(st, waiting_for, 0);
+    st_write_end(st);
+    ST_SET(st, acq, 0);
+    ST_SET(st, contended, 0);
+    int top = atomic_load(&slots_top);
+    while (top < i+1 && !atomic_compare_exchange_weak(&slots_top, &top, i+1)) {}
+    self = st;
+    bypass = 1;  // pthread_setspecific pode travar algo: não reentrar
+    if (wd_key_ok) pthread_setspecific(wd_key, st);
+    bypass = 0;
+    return st;
+  }
+  bypass = 1;  // sem vaga: esta thread não é anotada
+  return NULL;
+}
+
+// ---------- anotação ----------
+static void wd_wait_begin(wd_slot_t *st, pthread_mutex_t *m, void *pc){
+  long long t = now_ns();
+  st_write_begin(st);
+  ST_SET(st, wait_since_ns, t);
+  ST_SET(st, wait_pc, (uintptr_t)pc);
+  ST_SET(st, waiting_for, (uintptr_t)m);
+  st_write_end(st);
+}
+
+// fim de uma aquisição: registra o lock (se pegou) e limpa a espera (se houve)
+static void wd_acquire_end(wd_slot_t *st, pthread_mutex_t *m, void *pc, int got, int waited){
+  st_write_begin(st);
+  if (got){
+    int n = ST_GET(st, nheld);
+    if (n < WD_MAX_HOLDS){
+      ST_SET(st, held[n], (uintptr_t)m);
+      ST_SET(st, held_pc[n], (uintptr_t)pc);
+      ST_SET(st, nheld, n+1);
+    }
+  }
+  if (waited) ST_SET(st, waiting_for, 0);
+  st_write_end(st);
+  if (got) ST_SET(st, acq, ST_GET(st, acq) + 1);
+  if (waited) ST_SET(st, contended, ST_GET(st, contended) + 1);
+}
+
+// devolve de onde o lock foi pego (0 = não estava anotado)
+static uintptr_t wd_release(wd_slot_t *st, pthread_mutex_t *m){
+  int n = ST_GET(st, nheld);
+  for (int i=n-1;i>=0;i--){
+    if (ST_GET(st, held[i]) != (uintptr_t)m) continue;
+    uintptr_t pc = ST_GET(st, held_pc[i]);
+    st_write_begin(st);
+    ST_SET(st, held[i], ST_GET(st, held[n-1]));
+    ST_SET(st, held_pc[i], ST_GET(st, held_pc[n-1]));
+    ST_SET(st, nheld, n-1);
+    st_write_end(st);
+    return pc;
+  }
+  // não anotado (pego antes da thread ter vaga, ou além de WD_MAX_HOLDS)
+  return 0;
+}
+
+// ---------- interposição ----------
+// Caminho rápido: trylock. Só quem vai bloquear publica a espera e lê o relógio.
+int pthread_mutex_lock(pthread_mutex_t *m){
+  if (!real_lock) wd_resolve();
+  wd_slot_t *st = wd_self();
+  if (!st) return real_lock(m);
+  void *pc = __builtin_return_address(0);
+  int rc = real_trylock(m), waited = 0;
+  if (rc == EBUSY){
+    waited = 1;
+    wd_wait_begin(st, m, pc);
+    rc = real_lock(m);
+  }
+  wd_acquire_end(st, m, pc, rc == 0 || rc == EOWNERDEAD, waited);
+  return rc;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *m){
+  if (!real_lock) wd_resolve();
+  wd_slot_t *st = wd_self();
+  int rc = real_trylock(m);
+  if (st && (rc == 0 || rc == EOWNERDEAD))
+    wd_acquire_end(st, m, __builtin_return_address(0), 1, 0);
+  return rc;
+}
+
+int pthread_mutex_timedlock(pthread_mutex_t *m, const struct timespec *abstime){
+  if (!real_lock) wd_resolve();
+  wd_slot_t *st = wd_self();
+  if (!st) return real_timedlock(m, abstime);
+  void *pc = __builtin_return_address(0);
+  int rc = real_trylock(m), waited = 0;
+  if (rc == EBUSY){
+    waited = 1;
+    wd_wait_begin(st, m, pc);
+    rc = real_timedlock(m, abstime);
+  }
+  wd_acquire_end(st, m, pc, rc == 0 || rc == EOWNERDEAD, waited);
+  return rc;
+}
+
+// um programa que chama clocklock foi ligado a uma glibc que a tem; ENOSYS só
+// se a biblioteca for carregada numa glibc mais velha que a do programa
+int pthread_mutex_clocklock(pthread_mutex_t *m, clockid_t clk, const struct timespec *abstime){
+  if (!real_lock) wd_resolve();
+  if (!real_clocklock) return ENOSYS;
+  wd_slot_t *st = wd_self();
+  if (!st) return real_clocklock(m, clk, abstime);
+  void *pc = __builtin_return_address(0);
+  int rc = real_trylock(m), waited = 0;
+  if (rc == EBUSY){
+    waited = 1;
+    wd_wait_begin(st, m, pc);
+    rc = real_clocklock(m, clk, abstime);
+  }
+  wd_acquire_end(st, m, pc, rc == 0 || rc == EOWNERDEAD, waited);
+  return rc;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *m){
+  if (!real_lock) wd_resolve();
+  // antes do unlock: o grafo nunca aponta para um ex-dono
+  if (self) wd_release(self, m);
+  return real_unlock(m);
+}
+
+// A espera no cond não segura o mutex: sem isto a thread seguiria anotada como
+// dona e o detector acharia dois donos. O mutex volta à lista quando a chamada
+// retorna (com ou sem timeout, ele está de novo com a thread). A reaquisição
+// interna da glibc, depois do sinal, não passa pelo pthread_mutex_lock e não
+// aparece como espera.
+int pthread_cond_wait(pthread_cond_t *c, pthread_mutex_t *m){
+  if (!real_lock) wd_resolve();
+  wd_slot_t *st = wd_self();
+  uintptr_t pc = st ? wd_release(st, m) : 0;
+  int rc = real_cond_wait(c, m);
+  if (pc) wd_acquire_end(st, m, (void*)pc, 1, 0);
+  return rc;
+}
+
+int pthread_cond_timedwait(pthread_cond_t *c, pthread_mutex_t *m, const struct timespec *abstime){
+  if (!real_lock) wd_resolve();
+  wd_slot_t *st = wd_self();
+  uintptr_t pc = st ? wd_release(st, m) : 0;
+  int rc = real_cond_timedwait(c, m, abstime);
+  if (pc) wd_acquire_end(st, m, (void*)pc, 1, 0);
+  return rc;
+}
+
+int pthread_cond_clockwait(pthread_cond_t *c, pthread_mutex_t *m, clockid_t clk, const struct timespec *abstime){
+  if (!real_lock) wd_resolve();
+  if (!real_cond_clockwait) return ENOSYS;
+  wd_slot_t *st = wd_self();
+  uintptr_t pc = st ? wd_release(st, m) : 0;
+  int rc = real_cond_clockwait(c, m, clk, abstime);
+  if (pc) wd_acquire_end(st, m, (void*)pc, 1, 0);
+  return rc;
+}
+
+// ---------- relatório ----------
+static int log_fd = STDERR_FILENO;
+
+// sem stdio: o programa pode estar travado segurando o lock do stderr
+static void wd_log(const char *fmt, ...){
+  char buf[512];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof buf, fmt, ap);
+  va_end(ap);
+  if (n > (int)sizeof buf - 1) n = sizeof buf - 1;
+  if (n > 0 && write(log_fd, buf, n) < 0) {}
+}
+
+static const char *sym_name(uintptr_t pc, char *buf, size_t len){
+  Dl_info di;
+  if (pc && dladdr((void*)pc, &di) && di.dli_sname)
+    snprintf(buf, len, "%s+0x%lx", di.dli_sname, (unsigned long)(pc - (uintptr_t)di.dli_saddr));
+  else if (pc && dladdr((void*)pc, &di) && di.dli_fname)
+    snprintf(buf, len, "%s+0x%lx", strrchr(di.dli_fname, '/') ? strrchr(di.dli_fname, '/')+1 : di.dli_fname,
+             (unsigned long)(pc - (uintptr_t)di.dli_fbase));
+  else snprintf(buf, len, "%p", (void*)pc);
+  return buf;
+}
+
+// ---------- detector ----------
+typedef struct {
+  int tid, nheld;
+  uintptr_t waiting_for, wait_pc;
+  long long wait_since_ns;
+  uintptr_t held[WD_MAX_HOLDS], held_pc[WD_MAX_HOLDS];
+} wd_snap_t;
+
+static void wd_snapshot(wd_slot_t *st, wd_snap_t *o){
+  for (;;){
+    unsigned q1 = atomic_load_explicit(&st->seq, memory_order_acquire);
+    o->tid = ST_GET(st, tid);
+    o->nheld = ST_GET(st, nheld);
+    if (o->nheld > WD_MAX_HOLDS) o->nheld = WD_MAX_HOLDS;
+    for (int i=0;i<o->nheld;i++){ o->held[i] = ST_GET(st, held[i]); o->held_pc[i] = ST_GET(st, held_pc[i]); }
+    o->waiting_for = ST_GET(st, waiting_for);
+    o->wait_pc = ST_GET(st, wait_pc);
+    o->wait_since_ns = ST_GET(st, wait_since_ns);
+    atomic_thread_fence(memory_order_acquire);
+    unsigned q2 = atomic_load_explicit(&st->seq, memory_order_relaxed);
+    if (q1 == q2 && !(q1 & 1)) return;
+    sched_yield();
+  }
+}
+
+static struct {
+  int period_ms, stall_ms, abort_on_deadlock, summary;
+  atomic_int stop;
+  pthread_t th;
+  long deadlocks, stalls;
+} wd = { .period_ms = 100, .stall_ms = 3000 };
+
+// só o detector usa (estáticos: podem ser grandes)
+static wd_snap_t snap[WD_MAX_THREADS];
+static int live[WD_MAX_THREADS], owner_of[WD_MAX_THREADS], mark[WD_MAX_THREADS];
+
+#define WD_OWNER_NONE      (-1)  // nenhuma vaga segura o mutex
+#define WD_OWNER_AMBIGUOUS (-2)  // mais de uma: unlock por outra thread, endereço reusado...
+
+// dono do mutex que i espera; com mais de um candidato não há aresta confiável
+static int wd_owner(int n, int i){
+  uintptr_t m = snap[i].waiting_for;
+  int owner = WD_OWNER_NONE;
+  for (int j=0;j<n;j++){
+    if (!live[j]) continue;
+    for (int k=0;k<snap[j].nheld;k++){
+      if (snap[j].held[k] != m) continue;
+      if (owner >= 0 && owner != j) return WD_OWNER_AMBIGUOUS;
+      owner = j;  // j == i: relock de mutex normal que ela mesma segura
+    }
+  }
+  return owner;
+}
+
+// lê todas as vagas e monta as arestas esperando → dono
+static int wd_build(void){
+  int n = atomic_load(&slots_top);
+  for (int i=0;i<n;i++){
+    live[i] = atomic_load_explicit(&slots[i].used, memory_order_acquire);
+    if (live[i]) wd_snapshot(&slots[i], &snap[i]);
+  }
+  for (int i=0;i<n;i++)
+    owner_of[i] = live[i] && snap[i].waiting_for ? wd_owner(n, i) : WD_OWNER_NONE;
+  return n;
+}
+
+static void wd_print_thread(int i){
+  char s[160];
+  wd_log("  tid %d espera %p há %.1f ms em %s\n", snap[i].tid, (void*)snap[i].waiting_for,
+         (now_ns() - snap[i].wait_since_ns)/1e6, sym_name(snap[i].wait_pc, s, sizeof s));
+  for (int k=0;k<snap[i].nheld;k++)
+    wd_log("      segura %p (pego em %s)\n", (void*)snap[i].held[k], sym_name(snap[i].held_pc[k], s, sizeof s));
+}
+
+static void wd_scan(void){
+  int n = wd_build();
+  for (int i=0;i<n;i++) mark[i] = -1;
+  for (int s=0;s<n;s++){
+    if (mark[s] != -1 || owner_of[s] < 0) continue;
+    int t = s;
+    while (t >= 0 && mark[t] == -1){ mark[t] = s; t = owner_of[t]; }
+    if (t < 0 || mark[t] != s) continue;  // cadeia termina, ou caiu num caminho já visto
+    // t está num ciclo: confirma relendo (ciclo transitório some; deadlock fica igual)
+    int cyc[WD_MAX_THREADS], len = 0, fresh = 0;
+    long long since[WD_MAX_THREADS];
+    int u = t;
+    do { cyc[len] = u; since[len] = snap[u].wait_since_ns; len++; u = owner_of[u]; } while (u != t);
+    for (int k=0;k<len;k++) if (slots[cyc[k]].reported_since != since[k]) fresh = 1;
+    if (!fresh) continue;
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = 1000000L };
+    nanosleep(&ts, NULL);
+    wd_build();
+    int same = 1;
+    for (int k=0;k<len && same;k++)
+      same = live[cyc[k]] && snap[cyc[k]].wait_since_ns == since[k] && owner_of[cyc[k]] == cyc[(k+1)%len];
+    if (!same) return;  // o grafo mudou: próxima varredura
+    wd.deadlocks++;
+    wd_log("\n[watchdog] Deadlock: ciclo de %d thread(s)\n  ", len);
+    for (int k=0;k<len;k++) wd_log("tid %d -(%p)-> ", snap[cyc[k]].tid, (void*)snap[cyc[k]].waiting_for);
+    wd_log("tid %d\n", snap[cyc[0]].tid);
+    for (int k=0;k<len;k++){ wd_print_thread(cyc[k]); slots[cyc[k]].reported_since = since[k]; }
+    if (wd.abort_on_deadlock) abort();
+    return;
+  }
+  // esperas longas sem ciclo: mostra a cadeia até quem está rodando (ou em cond_wait)
+  long long now = now_ns();
+  for (int i=0;i<n;i++){
+    if (!live[i] || !snap[i].waiting_for) continue;
+    if (now - snap[i].wait_since_ns < (long long)wd.stall_ms*1000000LL) continue;
+    if (slots[i].reported_since == snap[i].wait_since_ns) continue;
+    slots[i].reported_since = snap[i].wait_since_ns;
+    wd.stalls++;
+    wd_log("\n[watchdog] Espera longa (≥ %d ms) sem ciclo:\n", wd.stall_ms);
+    int t = i;
+    for (int hop=0; t >= 0 && hop < 8; hop++){
+      if (snap[t].waiting_for) wd_print_thread(t);
+      else {
+        char s[160];
+        wd_log("  tid %d não espera por mutex (rodando, ou em pthread_cond_wait)\n", snap[t].tid);
+        for (int k=0;k<snap[t].nheld;k++)
+          wd_log("      segura %p (pego em %s)\n", (void*)snap[t].held[k], sym_name(snap[t].held_pc[k], s, sizeof s));
+        break;
+      }
+      int prev = t;
+      t = owner_of[t];
+      if (t == WD_OWNER_NONE) wd_log("  dono não anotado\n");
+      if (t == WD_OWNER_AMBIGUOUS){
+        wd_log("  dono ambíguo: %p aparece como segurado por", (void*)snap[prev].waiting_for);
+        for (int j=0;j<n;j++){
+          if (!live[j]) continue;
+          for (int k=0;k<snap[j].nheld;k++)
+            if (snap[j].held[k] == snap[prev].waiting_for){ wd_log(" tid %d", snap[j].tid); break; }
+        }
+        wd_log("\n");
+      }
+    }
+  }
+}
+
+static void *wd_main(void *arg){
+  (void)arg;
+  bypass = 1;
+  while (!atomic_load(&wd.stop)){
+    struct timespec ts = { .tv_sec = wd.period_ms/1000, .tv_nsec = (wd.period_ms%1000)*1000000L };
+    nanosleep(&ts, NULL);
+    wd_scan();
+  }
+  return NULL;
+}
+
+static void wd_start(void){
+  pthread_attr_t at;
+  pthread_attr_init(&at);
+  pthread_attr_setdetachstate(&at, PTHREAD_CREATE_DETACHED);
+  bypass = 1;
+  if (pthread_create(&wd.th, &at, wd_main, NULL) != 0) wd_log("[watchdog] sem thread do detector\n");
+  bypass = 0;
+  pthread_attr_destroy(&at);
+}
+
+// no filho só a thread que chamou fork existe: solta as outras vagas. Uma
+// dona pode ter sido copiada no meio de uma escrita (seq ímpar): zera seq,
+// senão a próxima ocupante herdaria a paridade e wd_snapshot nunca sairia.
+static void wd_atfork_child(void){
+  for (int i=0;i<atomic_load(&slots_top);i++){
+    if (&slots[i] == self) continue;
+    atomic_store(&slots[i].seq, 0);
+    atomic_store(&slots[i].used, 0);
+  }
+  wd_start();
+}
+
+static int env_int(const char *name, int def){
+  const char *v = getenv(name);
+  return v && *v ? atoi(v) : def;
+}
+
+__attribute__((constructor))
+static void wd_init(void){
+  wd_resolve();
+  wd.period_ms = env_int("WATCHDOG_PERIOD_MS", 100);
+  if (wd.period_ms < 1) wd.period_ms = 1;
+  wd.stall_ms = env_int("WATCHDOG_STALL_MS", 3000);
+  wd.abort_on_deadlock = env_int("WATCHDOG_ABORT", 0);
+  wd.summary = env_int("WATCHDOG_SUMMARY", 0);
+  const char *path = getenv("WATCHDOG_LOG");
+  if (path && *path){
+    int fd = open(path, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+    if (fd >= 0) log_fd = fd;
+  }
+  wd_key_ok = pthread_key_create(&wd_key, wd_thread_exit) == 0;
+  pthread_atfork(NULL, NULL, wd_atfork_child);
+  wd_start();
+}
+
+__attribute__((destructor))
+static void wd_fini(void){
+  atomic_store(&wd.stop, 1);
+  // programas sem problema saem calados (o preload vale para todo processo filho)
+  if (!wd.summary && !wd.deadlocks && !wd.stalls) return;
+  long acq = atomic_load(&done_acq), cont = atomic_load(&done_contended);
+  for (int i=0;i<atomic_load(&slots_top);i++)
+    if (atomic_load(&slots[i].used)){ acq += ST_GET(&slots[i], acq); cont += ST_GET(&slots[i], contended); }
+  wd_log("[watchdog] pid %d: %d vaga(s) de thread, %ld aquisições (%.1f%% disputadas), "
+         "%ld deadlock(s), %ld espera(s) longa(s)\n", (int)getpid(), atomic_load(&slots_top), acq,
+         acq ? 100.0*cont/acq : 0.0, wd.deadlocks, wd.stalls);
+}
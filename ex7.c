@@ -2,7 +2,10 @@
 // Simulação dos Filósofos com duas estratégias anti-deadlock:
 //  a) Ordem global de aquisição dos garfos
 //  b) Semáforo (garçom) limitando a N-1 filósofos simultâneos
+//  c) Aquisição otimista: trylock nos demais garfos + backoff exponencial aleatório
 // Coleta métricas por filósofo e mitiga starvation via limite de sequência + backoff educado.
+// A mesa é um grafo de conflitos (anel por padrão, ou grade/clique/aleatório/arquivo):
+// cada filósofo precisa de todos os garfos das arestas incidentes a ele.
 
 #define _GNU_SOURCE
 #include <pthread.h>
@@ -13,10 +16,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
-typedef enum { STRAT_ORDER = 1, STRAT_WAITER = 2 } strategy_t;
+typedef enum { STRAT_ORDER = 1, STRAT_WAITER = 2, STRAT_TRYLOCK = 3 } strategy_t;
+
+// Histograma log-linear: 16 sub-faixas por potência de 2 (erro relativo < 7%).
+#define HIST_SUB     16
+#define HIST_BUCKETS (61 * HIST_SUB)
 
 typedef struct {
     unsigned id;
@@ -27,10 +35,27 @@ typedef struct {
     uint64_t total_wait_ns;
     uint64_t max_wait_ns;
     uint64_t consec_meals;
+    uint64_t wait_hist[HIST_BUCKETS]; // histograma log-linear da espera (ns)
+    // contenção (só STRAT_TRYLOCK)
+    uint64_t failed_tries;   // trylock que falhou e forçou devolver garfos
+    uint64_t backoff_ns;     // tempo total dormindo em backoff
 } phil_t;
 
+typedef enum { TOPO_RING = 1, TOPO_GRID, TOPO_CLIQUE, TOPO_RANDOM, TOPO_FILE } topology_t;
+
+#define MAX_VERTICES (1 << 16) // teto de índice no arquivo de grafo (N vira maior índice + 1)
+
+// capacidade do garçom: > 0 fixa; valores especiais abaixo
+#define WAITER_CAP_GIRTH  (-1) // cintura - 1 (sem ciclo completo dentro do salão)
+#define WAITER_CAP_MIS    (-2) // conjunto independente guloso (limitado pela cintura)
+
 static int N = 5;
 static strategy_t STRATEGY = STRAT_ORDER;
+static topology_t TOPOLOGY = TOPO_RING;
+static const char *GRAPH_PATH = NULL;
+static double EDGE_PROB = 0.3;       // só para TOPO_RANDOM
+static unsigned GRAPH_SEED = 42;     // grafo aleatório reprodutível
+static int WAITER_CAP = WAITER_CAP_GIRTH;
 static int RUN_SECONDS = 10;
 
 // parâmetros de tempo (ms)
@@ -40,9 +65,23 @@ static int EAT_MIN_MS   = 5, EAT_MAX_MS   = 15;
 // mitigação de starvation
 static uint64_t CONSEC_LIMIT = 3;
 
+// backoff exponencial da estratégia trylock (us)
+static int BACKOFF_MIN_US = 50, BACKOFF_MAX_US = 5000;
+
+// grafo de conflitos: vértices = filósofos, arestas = garfos
+static int M = 0;                       // número de garfos (arestas)
+static int M_cap = 0;
+static int (*edges)[2];                 // edges[f] = {u, v}
+static int **need;                      // garfos de cada filósofo, ordem natural
+static int **need_sorted;               // mesmos garfos em ordem global crescente
+static int *n_need;
+static int **nbr;                       // vizinhos (compartilham ao menos um garfo)
+static int *n_nbr;
+
 // recursos compartilhados
-static pthread_mutex_t *forks;          // tamanho N
+static pthread_mutex_t *forks;          // tamanho M
 static sem_t waiter;                    // usado só na estratégia STRAT_WAITER
+static int waiter_cap;
 static pthread_mutex_t state_mx = PTHREAD_MUTEX_INITIALIZER;
 
 static atomic_bool running = true;
@@ -65,6 +104,27 @@ static void sleep_ms(int ms) {
     nanosleep(&ts, NULL);
 }
 
+static void sleep_us(int us) {
+    if (us <= 0) return;
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000L;
+    nanosleep(&ts, NULL);
+}
+
+// faixa de v (v < 0 cai na faixa 0)
+static int hist_bucket(long long v) {
+    if (v < HIST_SUB) return v < 0 ? 0 : (int)v;
+    int msb = 63 - __builtin_clzll((unsigned long long)v);
+    return (msb - 3) * HIST_SUB + (int)((v >> (msb - 4)) & (HIST_SUB - 1));
+}
+// limite superior (inclusivo) da faixa b
+static long long hist_upper(int b) {
+    if (b < HIST_SUB) return b;
+    int msb = b / HIST_SUB + 3;
+    return ((long long)(HIST_SUB + b % HIST_SUB + 1) << (msb - 4)) - 1;
+}
+
 static int rand_in_range(unsigned int *seed, int lo, int hi) {
     // retorna inteiro uniforme entre [lo, hi]
     if (hi < lo) { int t = lo; lo = hi; hi = t; }
@@ -72,56 +132,277 @@ static int rand_in_range(unsigned int *seed, int lo, int hi) {
     return lo + (int)(rand_r(seed) % (unsigned)span);
 }
 
-static inline int left_fork(int id)  { return id; }
-static inline int right_fork(int id) { return (id + 1) % N; }
-static inline int left_neighbor(int id)  { return (id - 1 + N) % N; }
-static inline int right_neighbor(int id) { return (id + 1) % N; }
+// ---------- construção do grafo ----------
+static bool add_edge(int u, int v) {
+    if (u < 0 || v < 0 || u >= MAX_VERTICES || v >= MAX_VERTICES || u == v) return false;
+    if (M == M_cap) {
+        int ncap = M_cap ? 2 * M_cap : 64;
+        void *p = realloc(edges, (size_t)ncap * sizeof(*edges));
+        if (!p) return false;
+        edges = p;
+        M_cap = ncap;
+    }
+    edges[M][0] = u;
+    edges[M][1] = v;
+    M++;
+    return true;
+}
+
+// Anel clássico: o garfo i liga o filósofo i (garfo esquerdo) ao i-1 (garfo direito).
+// Assim a ordem natural de cada filósofo é esquerdo -> direito, como na mesa original.
+static bool make_ring(void) {
+    for (int i = 0; i < N; ++i)
+        if (!add_edge(i, (i - 1 + N) % N)) return false;
+    return true;
+}
+
+// Grade aproximadamente quadrada com N vértices (vizinhança 4).
+static bool make_grid(void) {
+    int cols = 1;
+    while ((cols + 1) * (cols + 1) <= N) cols++;
+    for (int i = 0; i < N; ++i) {
+        if ((i % cols) + 1 < cols && i + 1 < N && !add_edge(i, i + 1)) return false;
+        if (i + cols < N && !add_edge(i, i + cols)) return false;
+    }
+    return true;
+}
+
+static bool make_clique(void) {
+    for (int i = 0; i < N; ++i)
+        for (int j = i + 1; j < N; ++j)
+            if (!add_edge(i, j)) return false;
+    return true;
+}
+
+// Erdős–Rényi G(N, p) com semente fixa (mesmo grafo para todas as estratégias).
+static bool make_random(void) {
+    unsigned int seed = GRAPH_SEED;
+    for (int i = 0; i < N; ++i)
+        for (int j = i + 1; j < N; ++j)
+            if ((double)rand_r(&seed) / ((double)RAND_MAX + 1.0) < EDGE_PROB &&
+                !add_edge(i, j)) return false;
+    return true;
+}
+
+// Lista de arestas: uma aresta "u v" por linha, '#' inicia comentário.
+// N passa a ser (maior índice de vértice + 1); índices ≥ MAX_VERTICES são
+// rejeitados como aresta inválida (senão uma linha "0 2000000000" aloca 2e9).
+static bool load_graph(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return false; }
+    char line[256];
+    int lineno = 0, maxv = -1;
+    while (fgets(line, sizeof line, f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        int u, v;
+        char extra;
+        int got = sscanf(line, "%d %d %c", &u, &v, &extra);
+        if (got <= 0) continue; // linha vazia
+        if (got != 2 || !add_edge(u, v)) {
+            fprintf(stderr, "%s:%d: aresta inválida\n", path, lineno);
+            fclose(f);
+            return false;
+        }
+        if (u > maxv) maxv = u;
+        if (v > maxv) maxv = v;
+    }
+    fclose(f);
+    if (maxv < 1) { fprintf(stderr, "%s: grafo precisa de ao menos 2 filósofos\n", path); return false; }
+    N = maxv + 1;
+    return true;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Monta as listas de garfos/vizinhos. Ordem natural: primeiro as arestas em que
+// o filósofo aparece na 1ª coluna, depois aquelas em que aparece na 2ª.
+static bool build_incidence(void) {
+    n_need = calloc((size_t)N, sizeof(*n_need));
+    n_nbr = calloc((size_t)N, sizeof(*n_nbr));
+    need = calloc((size_t)N, sizeof(*need));
+    need_sorted = calloc((size_t)N, sizeof(*need_sorted));
+    nbr = calloc((size_t)N, sizeof(*nbr));
+    if (!n_need || !n_nbr || !need || !need_sorted || !nbr) return false;
+
+    for (int f = 0; f < M; ++f) { n_need[edges[f][0]]++; n_need[edges[f][1]]++; }
+    for (int i = 0; i < N; ++i) {
+        size_t k = (size_t)(n_need[i] ? n_need[i] : 1);
+        need[i] = malloc(k * sizeof(int));
+        need_sorted[i] = malloc(k * sizeof(int));
+        nbr[i] = malloc(k * sizeof(int));
+        if (!need[i] || !need_sorted[i] || !nbr[i]) return false;
+        n_need[i] = 0;
+    }
+    for (int col = 0; col < 2; ++col) {
+        for (int f = 0; f < M; ++f) {
+            int me = edges[f][col], other = edges[f][1 - col];
+            need[me][n_need[me]] = f;
+            nbr[me][n_need[me]] = other;
+            n_need[me]++;
+        }
+    }
+    for (int i = 0; i < N; ++i) {
+        memcpy(need_sorted[i], need[i], (size_t)n_need[i] * sizeof(int));
+        qsort(need_sorted[i], (size_t)n_need[i], sizeof(int), cmp_int);
+        // vizinhos sem repetição (multiarestas compartilham o mesmo vizinho)
+        qsort(nbr[i], (size_t)n_need[i], sizeof(int), cmp_int);
+        int k = 0;
+        for (int j = 0; j < n_need[i]; ++j)
+            if (k == 0 || nbr[i][k-1] != nbr[i][j]) nbr[i][k++] = nbr[i][j];
+        n_nbr[i] = k;
+    }
+    return true;
+}
+
+static void free_graph(void) {
+    for (int i = 0; i < N; ++i) {
+        if (need) free(need[i]);
+        if (need_sorted) free(need_sorted[i]);
+        if (nbr) free(nbr[i]);
+    }
+    free(need); free(need_sorted); free(nbr);
+    free(n_need); free(n_nbr);
+    free(edges);
+}
+
+// Cintura (menor ciclo) via BFS a partir de cada vértice; 0 se acíclico.
+// Sem garçom, uma espera circular exige um ciclo inteiro do grafo disputando
+// garfos; com no máximo cintura-1 filósofos no salão nenhum ciclo fica completo.
+static int graph_girth(void) {
+    int best = 0;
+    int *dist = malloc((size_t)N * sizeof(int));
+    int *via = malloc((size_t)N * sizeof(int));   // aresta pela qual foi alcançado
+    int *queue = malloc((size_t)N * sizeof(int));
+    if (!dist || !via || !queue) { free(dist); free(via); free(queue); return 0; }
+    for (int s = 0; s < N; ++s) {
+        for (int i = 0; i < N; ++i) dist[i] = -1;
+        int qh = 0, qt = 0;
+        dist[s] = 0; via[s] = -1; queue[qt++] = s;
+        while (qh < qt) {
+            int x = queue[qh++];
+            if (best && 2 * dist[x] + 1 >= best) break;
+            for (int k = 0; k < n_need[x]; ++k) {
+                int f = need[x][k];
+                if (f == via[x]) continue;
+                int y = edges[f][0] == x ? edges[f][1] : edges[f][0];
+                if (dist[y] < 0) {
+                    dist[y] = dist[x] + 1; via[y] = f; queue[qt++] = y;
+                } else {
+                    int len = dist[x] + dist[y] + 1;
+                    if (best == 0 || len < best) best = len;
+                }
+            }
+        }
+        if (best == 2 || best == 3) break; // mínimo possível (multiaresta / triângulo)
+    }
+    free(dist); free(via); free(queue);
+    return best;
+}
+
+// Conjunto independente guloso (menor grau primeiro): quantos podem comer juntos.
+static int greedy_mis(void) {
+    bool *out = calloc((size_t)N, sizeof(bool));
+    if (!out) return 1;
+    int size = 0;
+    for (;;) {
+        int pick = -1;
+        for (int i = 0; i < N; ++i)
+            if (!out[i] && (pick < 0 || n_nbr[i] < n_nbr[pick])) pick = i;
+        if (pick < 0) break;
+        size++;
+        out[pick] = true;
+        for (int k = 0; k < n_nbr[pick]; ++k) out[nbr[pick][k]] = true;
+    }
+    free(out);
+    return size;
+}
+
+static int compute_waiter_cap(void) {
+    int girth = graph_girth();
+    int safe = girth ? girth - 1 : N; // acíclico: não há espera circular possível
+    if (safe < 1) safe = 1;
+    if (WAITER_CAP == WAITER_CAP_GIRTH) return safe;
+    if (WAITER_CAP == WAITER_CAP_MIS) {
+        int mis = greedy_mis();
+        return mis < safe ? mis : safe;
+    }
+    if (WAITER_CAP > safe)
+        fprintf(stderr, "Aviso: garçom=%d excede cintura-1=%d, deadlock é possível\n",
+                WAITER_CAP, safe);
+    return WAITER_CAP;
+}
 
 // tentativa de pegar garfos conforme estratégia escolhida
 static void take_forks_order(int id) {
-    int L = left_fork(id);
-    int R = right_fork(id);
-    int first = (L < R) ? L : R;
-    int second = (L < R) ? R : L;
-    pthread_mutex_lock(&forks[first]);
-    pthread_mutex_lock(&forks[second]);
+    for (int k = 0; k < n_need[id]; ++k)
+        pthread_mutex_lock(&forks[need_sorted[id][k]]);
 }
 
 static void put_forks_order(int id) {
-    int L = left_fork(id);
-    int R = right_fork(id);
-    int first = (L < R) ? L : R;
-    int second = (L < R) ? R : L;
-    pthread_mutex_unlock(&forks[second]);
-    pthread_mutex_unlock(&forks[first]);
+    for (int k = n_need[id] - 1; k >= 0; --k)
+        pthread_mutex_unlock(&forks[need_sorted[id][k]]);
 }
 
 static void take_forks_waiter(int id) {
-    // Primeiro pede "permissão" ao garçom (N-1 simultâneos)
+    // Primeiro pede "permissão" ao garçom (capacidade waiter_cap)
     sem_wait(&waiter);
-    // Depois pega os dois garfos (pode ser L depois R)
-    pthread_mutex_lock(&forks[left_fork(id)]);
-    pthread_mutex_lock(&forks[right_fork(id)]);
+    // Depois pega os garfos na ordem natural (sem ordem global)
+    for (int k = 0; k < n_need[id]; ++k)
+        pthread_mutex_lock(&forks[need[id][k]]);
 }
 
 static void put_forks_waiter(int id) {
-    pthread_mutex_unlock(&forks[right_fork(id)]);
-    pthread_mutex_unlock(&forks[left_fork(id)]);
+    for (int k = n_need[id] - 1; k >= 0; --k)
+        pthread_mutex_unlock(&forks[need[id][k]]);
     sem_post(&waiter);
 }
 
+// Otimista: bloqueia o primeiro garfo e tenta os demais com trylock. Se algum
+// estiver ocupado, devolve tudo e dorme um tempo aleatório em [cap/2, cap], com
+// cap dobrando a cada falha consecutiva (de BACKOFF_MIN_US até BACKOFF_MAX_US).
+// Pegar o primeiro com lock bloqueante é seguro: ninguém espera segurando garfo.
+static void take_forks_trylock(phil_t *p) {
+    int id = (int)p->id;
+    int cap_us = BACKOFF_MIN_US;
+    for (;;) {
+        if (n_need[id] == 0) return;
+        pthread_mutex_lock(&forks[need[id][0]]);
+        int k = 1;
+        while (k < n_need[id] && pthread_mutex_trylock(&forks[need[id][k]]) == 0) k++;
+        if (k == n_need[id]) return;
+
+        while (--k >= 0) pthread_mutex_unlock(&forks[need[id][k]]);
+        p->failed_tries++;
+        int us = rand_in_range(&p->rng, cap_us / 2, cap_us);
+        uint64_t b0 = now_ns();
+        sleep_us(us);
+        p->backoff_ns += now_ns() - b0;
+        if (cap_us < BACKOFF_MAX_US) cap_us = (cap_us * 2 < BACKOFF_MAX_US) ? cap_us * 2 : BACKOFF_MAX_US;
+    }
+}
+
+static void put_forks_trylock(int id) {
+    for (int k = n_need[id] - 1; k >= 0; --k)
+        pthread_mutex_unlock(&forks[need[id][k]]);
+}
+
 // mitigação simples de starvation: se já comeu CONSEC_LIMIT vezes
 // e algum vizinho está faminto, cede voluntariamente com um backoff.
 static void fairness_yield_if_needed(phil_t *p) {
     if (CONSEC_LIMIT == 0) return;
     if (p->consec_meals < CONSEC_LIMIT) return;
 
+    bool anyH = false;
     pthread_mutex_lock(&state_mx);
-    bool leftH  = hungry[left_neighbor(p->id)];
-    bool rightH = hungry[right_neighbor(p->id)];
+    for (int k = 0; k < n_nbr[p->id] && !anyH; ++k) anyH = hungry[nbr[p->id][k]];
     pthread_mutex_unlock(&state_mx);
 
-    if (leftH || rightH) {
+    if (anyH) {
         // cede educadamente: zera a sequência e tira um cochilo curto
         p->consec_meals = 0;
         sleep_ms(rand_in_range(&p->rng, 1, 3));
@@ -144,16 +425,17 @@ static void* philosopher_fn(void *arg) {
         pthread_mutex_unlock(&state_mx);
 
         // 3) Estratégia contra deadlock
-        if (STRATEGY == STRAT_ORDER) {
-            take_forks_order(p->id);
-        } else {
-            take_forks_waiter(p->id);
+        switch (STRATEGY) {
+            case STRAT_ORDER:   take_forks_order(p->id); break;
+            case STRAT_WAITER:  take_forks_waiter(p->id); break;
+            case STRAT_TRYLOCK: take_forks_trylock(p); break;
         }
 
         // 4) Começou a comer: mede espera
         uint64_t waited = now_ns() - t0;
         p->total_wait_ns += waited;
         if (waited > p->max_wait_ns) p->max_wait_ns = waited;
+        p->wait_hist[hist_bucket(waited)]++;
 
         // 5) Come
         p->meals += 1;
@@ -163,10 +445,10 @@ static void* philosopher_fn(void *arg) {
         sleep_ms(eat_ms);
 
         // 6) Larga os garfos
-        if (STRATEGY == STRAT_ORDER) {
-            put_forks_order(p->id);
-        } else {
-            put_forks_waiter(p->id);
+        switch (STRATEGY) {
+            case STRAT_ORDER:   put_forks_order(p->id); break;
+            case STRAT_WAITER:  put_forks_waiter(p->id); break;
+            case STRAT_TRYLOCK: put_forks_trylock(p->id); break;
         }
 
         pthread_mutex_lock(&state_mx);
@@ -179,25 +461,66 @@ static void* philosopher_fn(void *arg) {
     return NULL;
 }
 
+// listas da varredura: cada entrada é um valor ou um par a:b
+#define SWEEP_MAX 32
+typedef struct { int count; int v[SWEEP_MAX][2]; } sweep_list_t;
+
+static bool SWEEP = false;
+static int SWEEP_JOBS = 1;
+static sweep_list_t SWEEP_N, SWEEP_THINK, SWEEP_EAT, SWEEP_CONSEC;
+
+// "5,9,17" (pairs=false) ou "5:25,0:1" (pairs=true)
+static bool parse_list(const char *arg, bool pairs, sweep_list_t *out) {
+    out->count = 0;
+    const char *p = arg;
+    while (*p) {
+        if (out->count == SWEEP_MAX) return false;
+        int a, b, used;
+        if (pairs) {
+            if (sscanf(p, "%d:%d%n", &a, &b, &used) != 2) return false;
+        } else {
+            if (sscanf(p, "%d%n", &a, &used) != 1) return false;
+            b = a;
+        }
+        out->v[out->count][0] = a;
+        out->v[out->count][1] = b;
+        out->count++;
+        p += used;
+        if (*p == ',') p++;
+        else if (*p) return false;
+    }
+    return out->count > 0;
+}
+
 static void usage(const char *prog) {
     fprintf(stderr,
-      "Uso: %s [--strategy order|waiter] [--seconds S] [--philosophers N]\n"
+      "Uso: %s [--strategy order|waiter|trylock] [--seconds S] [--philosophers N]\n"
       "          [--think-ms a b] [--eat-ms a b] [--consec-limit K]\n"
-      "Padrões: strategy=order, seconds=10, N=5, think=5..25ms, eat=5..15ms, K=3\n",
+      "          [--topology ring|grid|clique|random] [--edge-prob p] [--graph-seed S]\n"
+      "          [--graph arquivo] [--waiter-cap girth|mis|K] [--backoff-us min max]\n"
+      "          [--sweep [--sweep-n L] [--sweep-think a:b,...] [--sweep-eat a:b,...]\n"
+      "                   [--sweep-consec L] [--jobs J]]\n"
+      "Padrões: strategy=order, seconds=10, N=5, think=5..25ms, eat=5..15ms, K=3,\n"
+      "         topology=ring, edge-prob=0.3, graph-seed=42, waiter-cap=girth, backoff=50..5000us\n"
+      "--sweep roda todas as estratégias sobre as listas (padrão: valores únicos acima)\n"
+      "e imprime uma linha CSV por execução; --jobs J roda J processos em paralelo.\n",
       prog);
 }
 
 static bool parse_args(int argc, char **argv) {
+    bool n_given = false;
     for (int i = 1; i < argc; ++i) {
         if (!strcmp(argv[i], "--strategy") && i+1 < argc) {
             if (!strcmp(argv[i+1], "order")) STRATEGY = STRAT_ORDER;
             else if (!strcmp(argv[i+1], "waiter")) STRATEGY = STRAT_WAITER;
+            else if (!strcmp(argv[i+1], "trylock")) STRATEGY = STRAT_TRYLOCK;
             else { usage(argv[0]); return false; }
             i++;
         } else if (!strcmp(argv[i], "--seconds") && i+1 < argc) {
             RUN_SECONDS = atoi(argv[++i]);
         } else if (!strcmp(argv[i], "--philosophers") && i+1 < argc) {
             N = atoi(argv[++i]);
+            n_given = true;
             if (N < 2) { fprintf(stderr, "N mínimo é 2\n"); return false; }
         } else if (!strcmp(argv[i], "--think-ms") && i+2 < argc) {
             THINK_MIN_MS = atoi(argv[++i]);
@@ -207,57 +530,159 @@ static bool parse_args(int argc, char **argv) {
             EAT_MAX_MS = atoi(argv[++i]);
         } else if (!strcmp(argv[i], "--consec-limit") && i+1 < argc) {
             CONSEC_LIMIT = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--topology") && i+1 < argc) {
+            ++i;
+            if (!strcmp(argv[i], "ring")) TOPOLOGY = TOPO_RING;
+            else if (!strcmp(argv[i], "grid")) TOPOLOGY = TOPO_GRID;
+            else if (!strcmp(argv[i], "clique")) TOPOLOGY = TOPO_CLIQUE;
+            else if (!strcmp(argv[i], "random")) TOPOLOGY = TOPO_RANDOM;
+            else { usage(argv[0]); return false; }
+        } else if (!strcmp(argv[i], "--edge-prob") && i+1 < argc) {
+            EDGE_PROB = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--graph-seed") && i+1 < argc) {
+            GRAPH_SEED = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--graph") && i+1 < argc) {
+            GRAPH_PATH = argv[++i];
+            TOPOLOGY = TOPO_FILE;
+        } else if (!strcmp(argv[i], "--backoff-us") && i+2 < argc) {
+            BACKOFF_MIN_US = atoi(argv[++i]);
+            BACKOFF_MAX_US = atoi(argv[++i]);
+            if (BACKOFF_MIN_US < 1 || BACKOFF_MAX_US < BACKOFF_MIN_US) { usage(argv[0]); return false; }
+        } else if (!strcmp(argv[i], "--sweep")) {
+            SWEEP = true;
+        } else if (!strcmp(argv[i], "--sweep-n") && i+1 < argc) {
+            if (!parse_list(argv[++i], false, &SWEEP_N)) { usage(argv[0]); return false; }
+        } else if (!strcmp(argv[i], "--sweep-think") && i+1 < argc) {
+            if (!parse_list(argv[++i], true, &SWEEP_THINK)) { usage(argv[0]); return false; }
+        } else if (!strcmp(argv[i], "--sweep-eat") && i+1 < argc) {
+            if (!parse_list(argv[++i], true, &SWEEP_EAT)) { usage(argv[0]); return false; }
+        } else if (!strcmp(argv[i], "--sweep-consec") && i+1 < argc) {
+            if (!parse_list(argv[++i], false, &SWEEP_CONSEC)) { usage(argv[0]); return false; }
+        } else if (!strcmp(argv[i], "--jobs") && i+1 < argc) {
+            SWEEP_JOBS = atoi(argv[++i]);
+            if (SWEEP_JOBS < 1) SWEEP_JOBS = 1;
+        } else if (!strcmp(argv[i], "--waiter-cap") && i+1 < argc) {
+            ++i;
+            if (!strcmp(argv[i], "girth")) WAITER_CAP = WAITER_CAP_GIRTH;
+            else if (!strcmp(argv[i], "mis")) WAITER_CAP = WAITER_CAP_MIS;
+            else if ((WAITER_CAP = atoi(argv[i])) < 1) { usage(argv[0]); return false; }
         } else {
             usage(argv[0]);
             return false;
         }
     }
+    // com --graph, N é o número de vértices do arquivo
+    if (TOPOLOGY == TOPO_FILE && (n_given || SWEEP_N.count > 0)) {
+        fprintf(stderr, "--graph define N pelo arquivo: não use --philosophers nem --sweep-n\n");
+        return false;
+    }
+    // listas não informadas usam o valor único corrente
+    if (SWEEP_N.count == 0) { SWEEP_N.count = 1; SWEEP_N.v[0][0] = N; }
+    if (SWEEP_THINK.count == 0) {
+        SWEEP_THINK.count = 1; SWEEP_THINK.v[0][0] = THINK_MIN_MS; SWEEP_THINK.v[0][1] = THINK_MAX_MS;
+    }
+    if (SWEEP_EAT.count == 0) {
+        SWEEP_EAT.count = 1; SWEEP_EAT.v[0][0] = EAT_MIN_MS; SWEEP_EAT.v[0][1] = EAT_MAX_MS;
+    }
+    if (SWEEP_CONSEC.count == 0) { SWEEP_CONSEC.count = 1; SWEEP_CONSEC.v[0][0] = (int)CONSEC_LIMIT; }
+    for (int i = 0; i < SWEEP_N.count; ++i)
+        if (SWEEP_N.v[i][0] < 2) { fprintf(stderr, "N mínimo é 2\n"); return false; }
     return true;
 }
 
-int main(int argc, char **argv) {
-    if (!parse_args(argc, argv)) return 1;
+// resultado agregado de uma execução (usado no relatório e no --sweep)
+typedef struct {
+    uint64_t meals;
+    double elapsed_s;
+    double wait_avg_ms, wait_p50_ms, wait_p95_ms, wait_p99_ms, wait_max_ms;
+    double jain;        // índice de justiça de Jain sobre refeições por filósofo
+    uint64_t failed;    // só trylock
+} run_result_t;
+
+// limitado ao máximo observado: o limite da faixa pode passar dele
+static double hist_percentile_ms(const uint64_t *h, uint64_t total, double q, long long max_ns) {
+    if (total == 0) return 0.0;
+    uint64_t target = (uint64_t)(q * (double)total);
+    if (target >= total) target = total - 1;
+    uint64_t acc = 0;
+    for (int b = 0; b < HIST_BUCKETS; ++b) {
+        acc += h[b];
+        if (acc > target) return (double)(hist_upper(b) < max_ns ? hist_upper(b) : max_ns) / 1e6;
+    }
+    return 0.0;
+}
+
+static const char *strategy_name(strategy_t s) {
+    switch (s) {
+        case STRAT_ORDER:   return "order";
+        case STRAT_WAITER:  return "waiter";
+        case STRAT_TRYLOCK: return "trylock";
+    }
+    return "?";
+}
 
-    printf("Estratégia: %s | N=%d | dur=%ds | think=%d..%dms | eat=%d..%dms | consecLimit=%llu\n",
-           (STRATEGY == STRAT_ORDER ? "ordem-global" : "garcom-4"),
-           N, RUN_SECONDS, THINK_MIN_MS, THINK_MAX_MS, EAT_MIN_MS, EAT_MAX_MS,
-           (unsigned long long)CONSEC_LIMIT);
+// Monta a mesa conforme os parâmetros globais, roda RUN_SECONDS e preenche *out.
+// Com verbose=false nada é impresso (modo --sweep).
+static bool run_simulation(bool verbose, run_result_t *out) {
+    bool built;
+    switch (TOPOLOGY) {
+        case TOPO_GRID:   built = make_grid(); break;
+        case TOPO_CLIQUE: built = make_clique(); break;
+        case TOPO_RANDOM: built = make_random(); break;
+        case TOPO_FILE:   built = load_graph(GRAPH_PATH); break;
+        default:          built = make_ring(); break;
+    }
+    if (!built || !build_incidence()) {
+        fprintf(stderr, "Falha ao montar o grafo de conflitos\n");
+        return false;
+    }
+    static const char *topo_names[] = { "", "anel", "grade", "clique", "aleatorio", "arquivo" };
+    waiter_cap = (STRATEGY == STRAT_WAITER) ? compute_waiter_cap() : 0;
+
+    if (verbose) {
+        char strat_name[32];
+        if (STRATEGY == STRAT_ORDER) snprintf(strat_name, sizeof strat_name, "ordem-global");
+        else if (STRATEGY == STRAT_TRYLOCK) snprintf(strat_name, sizeof strat_name, "trylock-backoff");
+        else snprintf(strat_name, sizeof strat_name, "garcom-%d", waiter_cap);
+        printf("Estratégia: %s | N=%d | dur=%ds | think=%d..%dms | eat=%d..%dms | consecLimit=%llu\n",
+               strat_name, N, RUN_SECONDS, THINK_MIN_MS, THINK_MAX_MS, EAT_MIN_MS, EAT_MAX_MS,
+               (unsigned long long)CONSEC_LIMIT);
+        printf("Topologia: %s | garfos=%d\n", topo_names[TOPOLOGY], M);
+    }
 
-    forks = calloc((size_t)N, sizeof(*forks));
+    forks = calloc((size_t)(M ? M : 1), sizeof(*forks));
     hungry = calloc((size_t)N, sizeof(*hungry));
     if (!forks || !hungry) {
         fprintf(stderr, "Falha de alocação\n");
-        return 1;
+        return false;
     }
 
-    for (int i = 0; i < N; ++i) pthread_mutex_init(&forks[i], NULL);
+    for (int i = 0; i < M; ++i) pthread_mutex_init(&forks[i], NULL);
     if (STRATEGY == STRAT_WAITER) {
-        // Permite no máximo N-1 filósofos "no salão" disputando garfos
-        sem_init(&waiter, 0, N - 1);
+        // Limita quantos filósofos ficam "no salão" disputando garfos (N-1 no anel)
+        sem_init(&waiter, 0, (unsigned)waiter_cap);
     }
 
     phil_t *ph = calloc((size_t)N, sizeof(*ph));
     if (!ph) {
         fprintf(stderr, "Falha de alocação\n");
-        return 1;
+        return false;
     }
 
     // cria threads
-    unsigned int seed0 = (unsigned int)time(NULL);
+    atomic_store(&running, true);
+    unsigned int seed0 = (unsigned int)time(NULL) ^ (unsigned int)getpid();
     for (int i = 0; i < N; ++i) {
         ph[i].id = (unsigned)i;
         ph[i].rng = seed0 ^ (0x9E3779B9u * (unsigned)i);
-        ph[i].meals = 0;
-        ph[i].total_wait_ns = 0;
-        ph[i].max_wait_ns = 0;
-        ph[i].consec_meals = 0;
         if (pthread_create(&ph[i].tid, NULL, philosopher_fn, &ph[i]) != 0) {
             perror("pthread_create");
-            return 1;
+            return false;
         }
     }
 
     // roda por RUN_SECONDS
+    uint64_t t_start = now_ns();
     for (int s = 0; s < RUN_SECONDS; ++s) {
         sleep(1);
     }
@@ -267,38 +692,153 @@ int main(int argc, char **argv) {
 
     // aguarda threads
     for (int i = 0; i < N; ++i) pthread_join(ph[i].tid, NULL);
+    double elapsed_s = (double)(now_ns() - t_start) / 1e9;
 
     // métricas
-    printf("\n== Métricas por filósofo ==\n");
+    if (verbose) printf("\n== Métricas por filósofo ==\n");
     uint64_t total_meals = 0;
     uint64_t max_wait_ns_global = 0;
     uint64_t sum_wait_ns = 0;
     uint64_t waited_cnt = 0;
+    uint64_t total_failed = 0, total_backoff_ns = 0;
+    double sum_sq_meals = 0.0;
+    uint64_t *hist = calloc(HIST_BUCKETS, sizeof(uint64_t));
+    if (!hist) {
+        fprintf(stderr, "Falha de alocação\n");
+        return false;
+    }
 
     for (int i = 0; i < N; ++i) {
         total_meals += ph[i].meals;
+        sum_sq_meals += (double)ph[i].meals * (double)ph[i].meals;
         if (ph[i].max_wait_ns > max_wait_ns_global) max_wait_ns_global = ph[i].max_wait_ns;
         sum_wait_ns += ph[i].total_wait_ns;
         waited_cnt += ph[i].meals;
+        total_failed += ph[i].failed_tries;
+        total_backoff_ns += ph[i].backoff_ns;
+        for (int b = 0; b < HIST_BUCKETS; ++b) hist[b] += ph[i].wait_hist[b];
+        if (!verbose) continue;
 
         double avg_ms = (ph[i].meals > 0) ? ((double)ph[i].total_wait_ns / 1e6) / (double)ph[i].meals : 0.0;
         double max_ms = (double)ph[i].max_wait_ns / 1e6;
 
-        printf("Filósofo %d: refeições=%llu | espera_média=%.3f ms | maior_espera=%.3f ms\n",
+        printf("Filósofo %d: refeições=%llu | espera_média=%.3f ms | maior_espera=%.3f ms",
                i, (unsigned long long)ph[i].meals, avg_ms, max_ms);
+        if (STRATEGY == STRAT_TRYLOCK) {
+            printf(" | falhas=%llu | backoff=%.3f ms | %.2f refeições/s",
+                   (unsigned long long)ph[i].failed_tries, (double)ph[i].backoff_ns / 1e6,
+                   elapsed_s > 0 ? (double)ph[i].meals / elapsed_s : 0.0);
+        }
+        printf("\n");
     }
 
-    double global_avg_ms = (waited_cnt > 0) ? ((double)sum_wait_ns / 1e6) / (double)waited_cnt : 0.0;
-    printf("\nTotal de refeições: %llu\n", (unsigned long long)total_meals);
-    printf("Espera média global: %.3f ms | Maior espera global: %.3f ms\n",
-           global_avg_ms, (double)max_wait_ns_global / 1e6);
+    out->meals = total_meals;
+    out->elapsed_s = elapsed_s;
+    out->wait_avg_ms = (waited_cnt > 0) ? ((double)sum_wait_ns / 1e6) / (double)waited_cnt : 0.0;
+    out->wait_p50_ms = hist_percentile_ms(hist, waited_cnt, 0.50, (long long)max_wait_ns_global);
+    out->wait_p95_ms = hist_percentile_ms(hist, waited_cnt, 0.95, (long long)max_wait_ns_global);
+    out->wait_p99_ms = hist_percentile_ms(hist, waited_cnt, 0.99, (long long)max_wait_ns_global);
+    out->wait_max_ms = (double)max_wait_ns_global / 1e6;
+    out->jain = (sum_sq_meals > 0) ? ((double)total_meals * (double)total_meals) / ((double)N * sum_sq_meals) : 0.0;
+    out->failed = total_failed;
+
+    if (verbose) {
+        printf("\nTotal de refeições: %llu | vazão=%.2f refeições/s | Jain=%.3f\n",
+               (unsigned long long)total_meals, elapsed_s > 0 ? (double)total_meals / elapsed_s : 0.0,
+               out->jain);
+        printf("Espera média global: %.3f ms | Maior espera global: %.3f ms\n",
+               out->wait_avg_ms, out->wait_max_ms);
+        printf("Espera p50/p95/p99: %.3f / %.3f / %.3f ms\n",
+               out->wait_p50_ms, out->wait_p95_ms, out->wait_p99_ms);
+        if (STRATEGY == STRAT_TRYLOCK) {
+            printf("Contenção: falhas=%llu (%.2f por refeição) | backoff total=%.3f ms\n",
+                   (unsigned long long)total_failed,
+                   total_meals ? (double)total_failed / (double)total_meals : 0.0,
+                   (double)total_backoff_ns / 1e6);
+        }
+    }
 
     // limpeza
     if (STRATEGY == STRAT_WAITER) sem_destroy(&waiter);
-    for (int i = 0; i < N; ++i) pthread_mutex_destroy(&forks[i]);
+    for (int i = 0; i < M; ++i) pthread_mutex_destroy(&forks[i]);
     free(forks);
     free(hungry);
     free(ph);
+    free(hist);
+    free_graph();
+
+    return true;
+}
+
+// ---------- varredura (--sweep) ----------
+// Produto cartesiano estratégia × N × think × eat × consec-limit. Cada execução
+// roda num processo filho (estado global limpo); até SWEEP_JOBS simultâneos.
+// Uma linha CSV por execução, escrita com um único write() pelo filho.
+
+static void run_sweep_child(strategy_t st, int n, const int think[2], const int eat[2], uint64_t consec) {
+    STRATEGY = st;
+    if (TOPOLOGY != TOPO_FILE) N = n;
+    THINK_MIN_MS = think[0]; THINK_MAX_MS = think[1];
+    EAT_MIN_MS = eat[0]; EAT_MAX_MS = eat[1];
+    CONSEC_LIMIT = consec;
+
+    run_result_t r;
+    if (!run_simulation(false, &r)) _exit(1);
+    char line[512];
+    int len = snprintf(line, sizeof line,
+        "%s,%d,%d,%d,%d,%d,%d,%llu,%d,%llu,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%.4f,%llu\n",
+        strategy_name(st), N, M, THINK_MIN_MS, THINK_MAX_MS, EAT_MIN_MS, EAT_MAX_MS,
+        (unsigned long long)CONSEC_LIMIT, waiter_cap,
+        (unsigned long long)r.meals, r.elapsed_s > 0 ? (double)r.meals / r.elapsed_s : 0.0,
+        r.wait_avg_ms, r.wait_p50_ms, r.wait_p95_ms, r.wait_p99_ms, r.wait_max_ms,
+        r.jain, (unsigned long long)r.failed);
+    if (write(STDOUT_FILENO, line, (size_t)len) != len) _exit(1);
+    _exit(0);
+}
+
+static int run_sweep(void) {
+    static const strategy_t strategies[] = { STRAT_ORDER, STRAT_WAITER, STRAT_TRYLOCK };
+    int failures = 0, active = 0;
+
+    printf("strategy,n,forks,think_min_ms,think_max_ms,eat_min_ms,eat_max_ms,consec_limit,"
+           "waiter_cap,meals,meals_per_s,wait_avg_ms,wait_p50_ms,wait_p95_ms,wait_p99_ms,"
+           "wait_max_ms,jain,failed_tries\n");
+    fflush(stdout);
+
+    for (int a = 0; a < (int)(sizeof strategies / sizeof strategies[0]); ++a)
+    for (int b = 0; b < SWEEP_N.count; ++b)
+    for (int c = 0; c < SWEEP_THINK.count; ++c)
+    for (int d = 0; d < SWEEP_EAT.count; ++d)
+    for (int e = 0; e < SWEEP_CONSEC.count; ++e) {
+        if (active == SWEEP_JOBS) {
+            int status;
+            if (wait(&status) > 0) {
+                active--;
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failures++;
+            }
+        }
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork"); failures++; continue; }
+        if (pid == 0) {
+            run_sweep_child(strategies[a], SWEEP_N.v[b][0], SWEEP_THINK.v[c], SWEEP_EAT.v[d],
+                            (uint64_t)SWEEP_CONSEC.v[e][0]);
+        }
+        active++;
+    }
+    while (active > 0) {
+        int status;
+        if (wait(&status) < 0) break;
+        active--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failures++;
+    }
+    if (failures) fprintf(stderr, "%d execução(ões) da varredura falharam\n", failures);
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    if (!parse_args(argc, argv)) return 1;
+    if (SWEEP) return run_sweep();
 
-    return 0;
+    run_result_t r;
+    return run_simulation(true, &r) ? 0 : 1;
 }
@@ -1,11 +1,23 @@
 // ex2_extended.c
 // Buffer circular P/C com bursts, backpressure (HWM/LWM) e logging de ocupação.
+// Alternativa à histerese: token bucket com taxa ajustada por AIMD ou PID.
+// Políticas de descarte (load shedding) para produtores que nunca bloqueiam.
+// Telemetria: ocupação lida sem lock (atômico), amostragem sub-ms e CSV
+// incremental em arquivo com rotação (--telemetry).
+// Replay de trace de chegadas (--trace, mmap + clock_nanosleep absoluto).
+// Pool elástico de consumidores escalado pela ocupação (--elastic).
+// Classes de prioridade com anéis próprios e retirada WRR/DRR (--classes).
+// Spill em disco acima do HWM no lugar do bloqueio (--spill, arquivo mapeado).
+// Consumo em lotes com custo por lote + por item (--batch, --cost).
+// Latência também medida desde o horário agendado (sem coordinated omission).
+// Validação com teoria de filas: Little, utilização e previsões M/M/c, M/D/c.
 //
-// Compilar:   gcc -std=c11 -O2 -pthread ex2_extended.c -o ex2_ext
+// Compilar:   gcc -std=c11 -O2 -pthread ex2_extended.c -o ex2_ext -lm
 // Executar:   ./ex2_ext
 // (Opcional)  ./ex2_ext -p 4 -c 2 -n 128 -d 15 -b 50 -i 300 -w 96:64 -s 50
 
 #define _GNU_SOURCE
+#include <getopt.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdatomic.h>
@@ -15,12 +27,23 @@
 #include <time.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 typedef struct {
   long id;
-  long long enq_ns; // timestamp de enfileiramento
+  long long enq_ns; // timestamp de enfileiramento (na inserção no buffer/spill)
+  long long intended_ns; // horário agendado pelo produtor, antes de qualquer espera
+  int cls;          // classe de prioridade (anel do buffer)
+  int spilled;      // marcado na retirada: passou pelo arquivo de spill
 } item_t;
 
+// ids especiais (nunca descartados pelo drop-oldest)
+#define POISON_ID (-1) // encerra consumidores
+#define PARK_ID   (-2) // pool elástico: o consumidor que retirar estaciona
+
 // ---------- tempo ----------
 static inline long long now_ns(void){
   struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -30,15 +53,65 @@ static inline void sleep_ms(int ms){
   struct timespec ts = { .tv_sec = ms/1000, .tv_nsec = (long)(ms%1000)*1000000L };
   nanosleep(&ts, NULL);
 }
+// dorme até o instante absoluto t (CLOCK_MONOTONIC); retorna na hora se já passou
+static inline void sleep_until_ns(long long t){
+  struct timespec ts = { .tv_sec = t/1000000000LL, .tv_nsec = (long)(t%1000000000LL) };
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
 
 // ---------- parâmetros ----------
+typedef enum { BP_HYST = 0, BP_AIMD, BP_PID } bp_mode_t;
+// block = espera (backpressure); as demais nunca bloqueiam o produtor
+typedef enum { DROP_BLOCK = 0, DROP_NEWEST, DROP_OLDEST, DROP_RED, DROP_SAMPLE } drop_policy_t;
+// retirada entre classes: weighted round-robin ou deficit round-robin
+typedef enum { SCHED_WRR = 0, SCHED_DRR } sched_t;
+#define MAX_CLASSES 8
+#define MAX_BATCH   256
+
 typedef struct {
   int P, C, N;
   int duration_s;
   int burst_size;
   int idle_ms;
   int hwm, lwm;      // high/low watermark
-  int sample_ms;     // período da amostragem da ocupação
+  int sample_us;     // período da amostragem da ocupação (-s em ms, --sample-us em µs)
+  const char *telemetry_path; // CSV incremental (NULL => série impressa no fim)
+  long long rotate_bytes;     // > 0: abre novo segmento ao passar deste tamanho
+  int rotate_keep;            // > 0: mantém só os últimos K segmentos (apaga ARQ.(seq-K))
+  int duration_set;           // -d informado (no replay, sem -d roda até o fim do trace)
+  // replay de trace (substitui as rajadas sintéticas)
+  const char *trace_path;
+  double trace_unit_ns;       // ns por unidade de timestamp do trace
+  double speed;               // > 1 acelera o replay
+  // pool elástico (cons_min == cons_max => pool fixo de C consumidores)
+  int cons_min, cons_max;
+  int scale_window_ms;        // tempo contínuo acima do HWM / abaixo do LWM p/ escalar
+  // controlador (bp != BP_HYST): token bucket com taxa ajustada a cada ctl_ms
+  bp_mode_t bp;
+  int ctl_ms;
+  double target_occ;        // set-point de ocupação (itens)
+  double target_lat_ms;     // > 0: set-point de latência no buffer (ms) no lugar da ocupação
+  double kp, ki, kd;        // ganhos PID (it/s por unidade de erro)
+  double aimd_add;          // it/s somados por período abaixo do alvo
+  double aimd_mul;          // fator multiplicativo acima do alvo
+  double rate_min, rate_max, rate0; // limites e taxa inicial (it/s)
+  // descarte
+  drop_policy_t drop;
+  double red_maxp;          // RED: prob. de descarte ao chegar no HWM
+  int sample_k;             // sample: acima do HWM aceita 1 a cada k
+  // classes de prioridade (pílulas vão para a última)
+  int classes;
+  sched_t sched;
+  double cls_mix[MAX_CLASSES];    // fração dos itens sintéticos de cada classe
+  double cls_weight[MAX_CLASSES]; // peso no escalonador (WRR: inteiro >= 1)
+  int cls_cap[MAX_CLASSES];       // capacidade do anel (0 => N dividido igualmente)
+  int cls_hwm[MAX_CLASSES], cls_lwm[MAX_CLASSES]; // marcas proporcionais à capacidade
+  // spill em disco: acima do HWM os itens vão para o arquivo em vez de bloquear
+  const char *spill_path;
+  long long spill_bytes;    // tamanho do arquivo mapeado
+  // consumo: até `batch` itens por retirada; custo = cost_batch_us + n*cost_item_us
+  int batch;
+  double cost_batch_us, cost_item_us;
 } config_t;
 
 static void set_defaults(config_t *cfg){
@@ -47,25 +120,187 @@ static void set_defaults(config_t *cfg){
   cfg->burst_size = 40;
   cfg->idle_ms = 250;
   cfg->hwm = 48; cfg->lwm = 32; // H>L (histerese)
-  cfg->sample_ms = 100;
+  cfg->sample_us = 100000;
+  cfg->telemetry_path = NULL;
+  cfg->rotate_bytes = 0;
+  cfg->rotate_keep = 0;
+  cfg->duration_set = 0;
+  cfg->trace_path = NULL;
+  cfg->trace_unit_ns = 1000.0; // µs
+  cfg->speed = 1.0;
+  cfg->cons_min = cfg->cons_max = 0; // 0 => fixo em C
+  cfg->scale_window_ms = 200;
+  cfg->bp = BP_HYST;
+  cfg->ctl_ms = 10;
+  cfg->target_occ = -1;     // -1 => (HWM+LWM)/2
+  cfg->target_lat_ms = 0;
+  cfg->kp = 10.0; cfg->ki = 40.0; cfg->kd = 0.0;
+  cfg->aimd_add = 20.0; cfg->aimd_mul = 0.7;
+  cfg->rate_min = 10.0; cfg->rate_max = 100000.0; cfg->rate0 = 500.0;
+  cfg->drop = DROP_BLOCK;
+  cfg->red_maxp = 0.1;
+  cfg->sample_k = 4;
+  cfg->classes = 1;
+  cfg->sched = SCHED_WRR;
+  for (int k=0;k<MAX_CLASSES;k++){ cfg->cls_mix[k] = 0; cfg->cls_weight[k] = 1; cfg->cls_cap[k] = 0; }
+  cfg->spill_path = NULL;
+  cfg->spill_bytes = 64LL << 20;
+  cfg->batch = 1;
+  cfg->cost_batch_us = 0; cfg->cost_item_us = 2000; // 2 ms por item
+}
+
+// lista "a:b:c" => até MAX_CLASSES valores; retorna quantos leu (-1 se inválida)
+static int parse_class_list(const char *s, double *out){
+  int n = 0;
+  while (*s){
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || n == MAX_CLASSES || v < 0) return -1;
+    out[n++] = v;
+    if (*end == ':') end++;
+    else if (*end) return -1;
+    s = end;
+  }
+  return n;
+}
+
+enum { OPT_BP = 256, OPT_CTL_MS, OPT_TARGET_OCC, OPT_TARGET_LAT, OPT_PID, OPT_AIMD, OPT_RATE,
+       OPT_DROP, OPT_SAMPLE_US, OPT_TELEMETRY, OPT_ROTATE_MB, OPT_ROTATE_KEEP, OPT_TRACE, OPT_TRACE_UNIT,
+       OPT_SPEED, OPT_ELASTIC, OPT_SCALE_WINDOW, OPT_CLASSES, OPT_CLASS_MIX, OPT_WEIGHTS,
+       OPT_CLASS_CAP, OPT_SCHED, OPT_SPILL, OPT_SPILL_MB, OPT_BATCH, OPT_COST };
+
+static void usage(const char *prog){
+  fprintf(stderr,
+    "Uso: %s [-p P] [-c C] [-n N] [-d S] [-b B] [-i MS] [-w H:L] [-s MS]\n"
+    "        [--bp hyst|aimd|pid] [--ctl-ms MS] [--target-occ X | --target-lat MS]\n"
+    "        [--pid KP:KI:KD] [--aimd ADD:MUL] [--rate MIN:INI:MAX]\n"
+    "        [--drop block|newest|oldest|red[:MAXP]|sample[:K]]\n"
+    "        [--sample-us US] [--telemetry ARQ [--rotate-mb MB [--rotate-keep K]]]\n"
+    "        [--trace ARQ [--trace-unit s|ms|us|ns] [--speed X]]\n"
+    "        [--elastic MIN:MAX [--scale-window MS]]\n"
+    "        [--classes K [--class-mix P0:P1:..] [--weights W0:W1:..]\n"
+    "         [--class-cap N0:N1:..] [--sched wrr|drr]]\n"
+    "        [--spill ARQ [--spill-mb MB]] [--batch K] [--cost LOTE_US:ITEM_US]\n", prog);
 }
 
 static void parse_args(int argc, char **argv, config_t *cfg){
   set_defaults(cfg);
+  static const struct option longopts[] = {
+    {"bp",         required_argument, NULL, OPT_BP},
+    {"ctl-ms",     required_argument, NULL, OPT_CTL_MS},
+    {"target-occ", required_argument, NULL, OPT_TARGET_OCC},
+    {"target-lat", required_argument, NULL, OPT_TARGET_LAT},
+    {"pid",        required_argument, NULL, OPT_PID},
+    {"aimd",       required_argument, NULL, OPT_AIMD},
+    {"rate",       required_argument, NULL, OPT_RATE},
+    {"drop",       required_argument, NULL, OPT_DROP},
+    {"sample-us",  required_argument, NULL, OPT_SAMPLE_US},
+    {"telemetry",  required_argument, NULL, OPT_TELEMETRY},
+    {"rotate-mb",  required_argument, NULL, OPT_ROTATE_MB},
+    {"rotate-keep", required_argument, NULL, OPT_ROTATE_KEEP},
+    {"trace",      required_argument, NULL, OPT_TRACE},
+    {"trace-unit", required_argument, NULL, OPT_TRACE_UNIT},
+    {"speed",      required_argument, NULL, OPT_SPEED},
+    {"elastic",    required_argument, NULL, OPT_ELASTIC},
+    {"scale-window", required_argument, NULL, OPT_SCALE_WINDOW},
+    {"classes",    required_argument, NULL, OPT_CLASSES},
+    {"class-mix",  required_argument, NULL, OPT_CLASS_MIX},
+    {"weights",    required_argument, NULL, OPT_WEIGHTS},
+    {"class-cap",  required_argument, NULL, OPT_CLASS_CAP},
+    {"sched",      required_argument, NULL, OPT_SCHED},
+    {"spill",      required_argument, NULL, OPT_SPILL},
+    {"spill-mb",   required_argument, NULL, OPT_SPILL_MB},
+    {"batch",      required_argument, NULL, OPT_BATCH},
+    {"cost",       required_argument, NULL, OPT_COST},
+    {NULL, 0, NULL, 0}
+  };
   int opt; int a,b;
-  while ((opt = getopt(argc, argv, "p:c:n:d:b:i:w:s:h")) != -1){
+  double lst[MAX_CLASSES];
+  int n_mix = 0, n_weights = 0, n_cap = 0;
+  while ((opt = getopt_long(argc, argv, "p:c:n:d:b:i:w:s:h", longopts, NULL)) != -1){
     switch(opt){
       case 'p': cfg->P = atoi(optarg); break;
       case 'c': cfg->C = atoi(optarg); break;
       case 'n': cfg->N = atoi(optarg); break;
-      case 'd': cfg->duration_s = atoi(optarg); break;
+      case 'd': cfg->duration_s = atoi(optarg); cfg->duration_set = 1; break;
       case 'b': cfg->burst_size = atoi(optarg); break;
       case 'i': cfg->idle_ms = atoi(optarg); break;
       case 'w':
         if (sscanf(optarg, "%d:%d", &a, &b)==2){ cfg->hwm=a; cfg->lwm=b; }
         break;
-      case 's': cfg->sample_ms = atoi(optarg); break;
-      default: break;
+      case 's': cfg->sample_us = atoi(optarg) * 1000; break;
+      case OPT_SAMPLE_US: cfg->sample_us = atoi(optarg); break;
+      case OPT_TELEMETRY: cfg->telemetry_path = optarg; break;
+      case OPT_TRACE: cfg->trace_path = optarg; break;
+      case OPT_TRACE_UNIT:
+        if (!strcmp(optarg, "s")) cfg->trace_unit_ns = 1e9;
+        else if (!strcmp(optarg, "ms")) cfg->trace_unit_ns = 1e6;
+        else if (!strcmp(optarg, "us")) cfg->trace_unit_ns = 1e3;
+        else if (!strcmp(optarg, "ns")) cfg->trace_unit_ns = 1.0;
+        else { usage(argv[0]); exit(1); }
+        break;
+      case OPT_SPEED: cfg->speed = atof(optarg); break;
+      case OPT_ELASTIC:
+        if (sscanf(optarg, "%d:%d", &a, &b) != 2){ usage(argv[0]); exit(1); }
+        cfg->cons_min = a; cfg->cons_max = b;
+        break;
+      case OPT_SCALE_WINDOW: cfg->scale_window_ms = atoi(optarg); break;
+      case OPT_CLASSES: cfg->classes = atoi(optarg); break;
+      case OPT_CLASS_MIX:
+        if ((n_mix = parse_class_list(optarg, cfg->cls_mix)) < 1){ usage(argv[0]); exit(1); }
+        break;
+      case OPT_WEIGHTS:
+        if ((n_weights = parse_class_list(optarg, cfg->cls_weight)) < 1){ usage(argv[0]); exit(1); }
+        break;
+      case OPT_CLASS_CAP:
+        if ((n_cap = parse_class_list(optarg, lst)) < 1){ usage(argv[0]); exit(1); }
+        for (int k=0;k<n_cap;k++) cfg->cls_cap[k] = (int)lst[k];
+        break;
+      case OPT_SPILL: cfg->spill_path = optarg; break;
+      case OPT_SPILL_MB: cfg->spill_bytes = (long long)(atof(optarg) * 1048576.0); break;
+      case OPT_BATCH: cfg->batch = atoi(optarg); break;
+      case OPT_COST:
+        if (sscanf(optarg, "%lf:%lf", &cfg->cost_batch_us, &cfg->cost_item_us) != 2){ usage(argv[0]); exit(1); }
+        break;
+      case OPT_SCHED:
+        if (!strcmp(optarg, "wrr")) cfg->sched = SCHED_WRR;
+        else if (!strcmp(optarg, "drr")) cfg->sched = SCHED_DRR;
+        else { usage(argv[0]); exit(1); }
+        break;
+      case OPT_ROTATE_MB: cfg->rotate_bytes = (long long)(atof(optarg) * 1048576.0); break;
+      case OPT_ROTATE_KEEP: cfg->rotate_keep = atoi(optarg); break;
+      case OPT_BP:
+        if (!strcmp(optarg, "hyst")) cfg->bp = BP_HYST;
+        else if (!strcmp(optarg, "aimd")) cfg->bp = BP_AIMD;
+        else if (!strcmp(optarg, "pid")) cfg->bp = BP_PID;
+        else { usage(argv[0]); exit(1); }
+        break;
+      case OPT_CTL_MS: cfg->ctl_ms = atoi(optarg); break;
+      case OPT_TARGET_OCC: cfg->target_occ = atof(optarg); break;
+      case OPT_TARGET_LAT: cfg->target_lat_ms = atof(optarg); break;
+      case OPT_PID:
+        if (sscanf(optarg, "%lf:%lf:%lf", &cfg->kp, &cfg->ki, &cfg->kd) != 3){ usage(argv[0]); exit(1); }
+        break;
+      case OPT_AIMD:
+        if (sscanf(optarg, "%lf:%lf", &cfg->aimd_add, &cfg->aimd_mul) != 2){ usage(argv[0]); exit(1); }
+        break;
+      case OPT_RATE:
+        if (sscanf(optarg, "%lf:%lf:%lf", &cfg->rate_min, &cfg->rate0, &cfg->rate_max) != 3){ usage(argv[0]); exit(1); }
+        break;
+      case OPT_DROP:
+        if (!strcmp(optarg, "block")) cfg->drop = DROP_BLOCK;
+        else if (!strcmp(optarg, "newest")) cfg->drop = DROP_NEWEST;
+        else if (!strcmp(optarg, "oldest")) cfg->drop = DROP_OLDEST;
+        else if (!strncmp(optarg, "red", 3)){
+          cfg->drop = DROP_RED;
+          if (optarg[3] == ':') cfg->red_maxp = atof(optarg+4);
+        } else if (!strncmp(optarg, "sample", 6)){
+          cfg->drop = DROP_SAMPLE;
+          if (optarg[6] == ':') cfg->sample_k = atoi(optarg+7);
+        } else { usage(argv[0]); exit(1); }
+        break;
+      case 'h': usage(argv[0]); exit(0);
+      default: usage(argv[0]); exit(1);
     }
   }
   if (cfg->P<1) cfg->P=1;
@@ -74,120 +309,638 @@ static void parse_args(int argc, char **argv, config_t *cfg){
   if (cfg->hwm > cfg->N-1) cfg->hwm = cfg->N-1;
   if (cfg->lwm < 0) cfg->lwm = 0;
   if (cfg->hwm <= cfg->lwm) cfg->hwm = cfg->lwm+1;
-  if (cfg->sample_ms < 10) cfg->sample_ms = 10;
+  if (cfg->sample_us < 50) cfg->sample_us = 50;
+  if (cfg->rotate_keep < 0) cfg->rotate_keep = 0;
+  if (cfg->speed <= 0) cfg->speed = 1.0;
+  if (cfg->cons_max > 0){
+    if (cfg->cons_min < 1) cfg->cons_min = 1;
+    if (cfg->cons_max < cfg->cons_min) cfg->cons_max = cfg->cons_min;
+    if (cfg->C < cfg->cons_min) cfg->C = cfg->cons_min;
+    if (cfg->C > cfg->cons_max) cfg->C = cfg->cons_max;
+  } else {
+    cfg->cons_min = cfg->cons_max = cfg->C;
+  }
+  if (cfg->scale_window_ms < 1) cfg->scale_window_ms = 1;
+  if (cfg->trace_path && !cfg->duration_set) cfg->duration_s = 365*24*3600; // até o fim do trace
+  if (cfg->ctl_ms < 1) cfg->ctl_ms = 1;
+  if (cfg->aimd_mul <= 0 || cfg->aimd_mul >= 1) cfg->aimd_mul = 0.7;
+  if (cfg->rate_min < 1) cfg->rate_min = 1;
+  if (cfg->rate_max < cfg->rate_min) cfg->rate_max = cfg->rate_min;
+  if (cfg->rate0 < cfg->rate_min) cfg->rate0 = cfg->rate_min;
+  if (cfg->rate0 > cfg->rate_max) cfg->rate0 = cfg->rate_max;
+  if (cfg->red_maxp < 0) cfg->red_maxp = 0;
+  if (cfg->red_maxp > 1) cfg->red_maxp = 1;
+  if (cfg->sample_k < 1) cfg->sample_k = 1;
+  if (cfg->batch < 1) cfg->batch = 1;
+  if (cfg->batch > MAX_BATCH) cfg->batch = MAX_BATCH;
+  if (cfg->cost_batch_us < 0) cfg->cost_batch_us = 0;
+  if (cfg->cost_item_us < 0) cfg->cost_item_us = 0;
+
+  // classes: listas devem ter K valores (ou ficar nos padrões)
+  int K = cfg->classes;
+  if (K < 1 || K > MAX_CLASSES ||
+      (n_mix && n_mix != K) || (n_weights && n_weights != K) || (n_cap && n_cap != K)){
+    fprintf(stderr, "--classes deve estar em 1..%d e --class-mix/--weights/--class-cap ter K valores\n",
+            MAX_CLASSES);
+    exit(1);
+  }
+  double mix_sum = 0;
+  for (int k=0;k<K;k++){
+    if (!n_mix) cfg->cls_mix[k] = 1.0;
+    mix_sum += cfg->cls_mix[k];
+    if (cfg->sched == SCHED_WRR){
+      cfg->cls_weight[k] = floor(cfg->cls_weight[k] + 0.5);
+      if (cfg->cls_weight[k] < 1) cfg->cls_weight[k] = 1;
+    } else if (cfg->cls_weight[k] <= 0){
+      fprintf(stderr, "--weights: quantum DRR deve ser > 0\n"); exit(1);
+    }
+  }
+  if (mix_sum <= 0){ fprintf(stderr, "--class-mix: soma zero\n"); exit(1); }
+  for (int k=0;k<K;k++) cfg->cls_mix[k] /= mix_sum;
+  if (n_cap){
+    cfg->N = 0;
+    for (int k=0;k<K;k++){
+      if (cfg->cls_cap[k] < 2) cfg->cls_cap[k] = 2;
+      cfg->N += cfg->cls_cap[k];
+    }
+  } else {
+    if (cfg->N < 2*K) cfg->N = 2*K;
+    for (int k=0;k<K;k++) cfg->cls_cap[k] = cfg->N / K + (k < cfg->N % K);
+  }
+  if (cfg->hwm > cfg->N-1) cfg->hwm = cfg->N-1;
+  if (cfg->hwm <= cfg->lwm) cfg->lwm = cfg->hwm-1;
+  for (int k=0;k<K;k++){
+    // mesmas frações de HWM/LWM em cada anel (K=1 => as marcas globais)
+    int c = cfg->cls_cap[k];
+    int h = (int)((long long)cfg->hwm * c / cfg->N);
+    int l = (int)((long long)cfg->lwm * c / cfg->N);
+    if (h > c-1) h = c-1;
+    if (h < 1) h = 1;
+    if (l >= h) l = h-1;
+    cfg->cls_hwm[k] = h; cfg->cls_lwm[k] = l;
+  }
+  if (cfg->target_occ < 0) cfg->target_occ = (cfg->hwm + cfg->lwm) / 2.0;
+
+  if (cfg->drop != DROP_BLOCK && cfg->bp != BP_HYST){
+    fprintf(stderr, "--drop %s não bloqueia produtores; não combina com --bp aimd/pid\n",
+            cfg->drop == DROP_NEWEST ? "newest" : cfg->drop == DROP_OLDEST ? "oldest" :
+            cfg->drop == DROP_RED ? "red" : "sample");
+    exit(1);
+  }
+  if (cfg->spill_path){
+    if (cfg->drop != DROP_BLOCK || cfg->bp != BP_HYST || cfg->classes != 1){
+      fprintf(stderr, "--spill substitui a espera da histerese: use com --drop block, --bp hyst e uma classe\n");
+      exit(1);
+    }
+    if (cfg->spill_bytes < (long long)sizeof(item_t) * 1024) cfg->spill_bytes = (long long)sizeof(item_t) * 1024;
+  }
 }
 
 // ---------- buffer circular ----------
+// Um anel por classe de prioridade, todos sob o mesmo mutex. sem_full conta os
+// itens de todos os anéis (consumidor não escolhe classe antes de acordar);
+// vagas, histerese e ocupação são por classe, então uma rajada de uma classe
+// não bloqueia nem atrasa a entrada das outras. Com uma classe o comportamento
+// é o do buffer único original.
 typedef struct {
   item_t *buf;
   int cap, head, tail;
-  pthread_mutex_t mtx;
-  sem_t sem_empty, sem_full;
-  // backpressure (histerese)
+  sem_t sem_empty;
+  // backpressure (histerese) da classe
   pthread_cond_t bp_cv;
   int hwm, lwm;
-  int occ; // ocupação atual (protegido por mtx)
+  atomic_int occ;
+  // escalonamento: WRR serve até `weight` itens seguidos; DRR soma `weight` ao
+  // déficit a cada visita e serve enquanto o déficit cobre um item
+  double weight, deficit;
+  int served;
+} cring_t;
+
+typedef struct {
+  int ncls;
+  cring_t ring[MAX_CLASSES];
+  int cap;
+  pthread_mutex_t mtx;
+  sem_t sem_full;
+  int hwm, lwm;   // marcas agregadas (pool elástico, alvo do controlador)
+  atomic_int occ; // ocupação total: escrita sob mtx, lida sem lock pela telemetria
+  sched_t sched;
+  int cur;        // classe da vez no round-robin
+  int fresh;      // DRR: cur acabou de receber a vez (ainda não somou o quantum)
+  // spill (--spill): registros item_t anexados num arquivo mapeado; lidos na
+  // ordem de escrita e, ao esvaziar, as posições voltam ao início do arquivo
+  item_t *spill;              // NULL => desativado
+  int spill_fd;
+  long spill_cap;             // registros que cabem no arquivo
+  long spill_rd, spill_wr;    // próximos a ler/escrever (sob mtx)
+  atomic_long spill_occ;      // itens no arquivo (lido sem lock pela telemetria)
+  long spill_total, spill_max;
+  long long spill_since, spill_active_ns; // tempo com o spill não vazio
+  // intervalos entre chegadas de itens de dados (Welford, sob mtx)
+  long long arr_last_ns;
+  long arr_n;
+  double arr_mean, arr_m2;
 } cbuf_t;
 
-static void cbuf_init(cbuf_t *q, int N, int hwm, int lwm){
-  q->buf = (item_t*)calloc(N, sizeof(item_t));
-  q->cap = N; q->head=0; q->tail=0; q->occ=0;
+// Welford combinado (Chan): junta (nb, mean_b, m2_b) ao acumulador (n, mean, m2)
+static void welford_merge(long *n, double *mean, double *m2, long nb, double mean_b, double m2_b){
+  if (nb <= 0) return;
+  long nt = *n + nb;
+  double d = mean_b - *mean;
+  *mean += d * nb / nt;
+  *m2 += m2_b + d * d * (double)*n * nb / nt;
+  *n = nt;
+}
+
+static inline int cbuf_occ(cbuf_t *q){
+  return atomic_load_explicit(&q->occ, memory_order_relaxed);
+}
+static inline int ring_occ(cring_t *r){
+  return atomic_load_explicit(&r->occ, memory_order_relaxed);
+}
+
+static void cbuf_init(cbuf_t *q, const config_t *cf){
+  q->ncls = cf->classes;
+  q->cap = cf->N; q->hwm = cf->hwm; q->lwm = cf->lwm;
+  q->sched = cf->sched; q->cur = 0; q->fresh = 1;
+  atomic_init(&q->occ, 0);
   pthread_mutex_init(&q->mtx, NULL);
-  pthread_cond_init(&q->bp_cv, NULL);
-  sem_init(&q->sem_empty, 0, N);
-  sem_init(&q->sem_full,  0, 0);
-  q->hwm=hwm; q->lwm=lwm;
+  sem_init(&q->sem_full, 0, 0);
+  for (int k=0;k<q->ncls;k++){
+    cring_t *r = &q->ring[k];
+    r->cap = cf->cls_cap[k];
+    r->buf = (item_t*)calloc(r->cap, sizeof(item_t));
+    r->head = 0; r->tail = 0;
+    atomic_init(&r->occ, 0);
+    pthread_cond_init(&r->bp_cv, NULL);
+    sem_init(&r->sem_empty, 0, r->cap);
+    r->hwm = cf->cls_hwm[k]; r->lwm = cf->cls_lwm[k];
+    r->weight = cf->cls_weight[k]; r->deficit = 0; r->served = 0;
+  }
+  q->spill = NULL;
+  atomic_init(&q->spill_occ, 0);
+  q->arr_last_ns = 0; q->arr_n = 0; q->arr_mean = q->arr_m2 = 0;
+}
+
+// chamar com mtx: registra o intervalo desde a chegada anterior (pílulas não contam)
+static void note_arrival_locked(cbuf_t *q, item_t *x){
+  x->enq_ns = now_ns();
+  if (x->id < 0) return;
+  if (q->arr_last_ns) welford_merge(&q->arr_n, &q->arr_mean, &q->arr_m2, 1, (double)(x->enq_ns - q->arr_last_ns), 0);
+  q->arr_last_ns = x->enq_ns;
+}
+
+static int spill_open(cbuf_t *q, const char *path, long long bytes){
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0){ perror(path); return -1; }
+  q->spill_cap = (long)(bytes / (long long)sizeof(item_t));
+  size_t len = (size_t)q->spill_cap * sizeof(item_t);
+  if (ftruncate(fd, (off_t)len) != 0){ perror("ftruncate"); close(fd); return -1; }
+  void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED){ perror("mmap"); close(fd); return -1; }
+  madvise(p, len, MADV_SEQUENTIAL);
+  q->spill = p; q->spill_fd = fd;
+  q->spill_rd = q->spill_wr = 0;
+  q->spill_total = q->spill_max = 0;
+  q->spill_active_ns = 0;
+  return 0;
 }
 static void cbuf_destroy(cbuf_t *q){
-  sem_destroy(&q->sem_empty);
+  if (q->spill){
+    munmap(q->spill, (size_t)q->spill_cap * sizeof(item_t));
+    close(q->spill_fd);
+  }
+  for (int k=0;k<q->ncls;k++){
+    sem_destroy(&q->ring[k].sem_empty);
+    pthread_cond_destroy(&q->ring[k].bp_cv);
+    free(q->ring[k].buf);
+  }
   sem_destroy(&q->sem_full);
-  pthread_cond_destroy(&q->bp_cv);
   pthread_mutex_destroy(&q->mtx);
-  free(q->buf);
+}
+
+// chamar com mtx e com uma vaga de r já reservada (sem_empty)
+static void ring_put_locked(cbuf_t *q, cring_t *r, item_t x){
+  note_arrival_locked(q, &x);
+  r->buf[r->tail] = x;
+  r->tail = (r->tail + 1) % r->cap;
+  int occ = atomic_fetch_add_explicit(&r->occ, 1, memory_order_relaxed) + 1;
+  atomic_fetch_add_explicit(&q->occ, 1, memory_order_relaxed);
+  if (occ <= r->lwm) pthread_cond_broadcast(&r->bp_cv);
+}
+
+// A poison pill só sai quando é a última coisa no buffer: o encerramento drena
+// as demais classes antes de derrubar os consumidores.
+static int ring_ready(cbuf_t *q, cring_t *r){
+  int occ = atomic_load_explicit(&r->occ, memory_order_relaxed);
+  return occ > 0 && (r->buf[r->head].id != POISON_ID ||
+                     atomic_load_explicit(&q->occ, memory_order_relaxed) == occ);
+}
+
+// Escolhe a classe a servir (chamar com mtx e com um item reservado em sem_full).
+// Anel vazio perde a vez e zera o déficit/contador, como no DRR clássico.
+static int sched_pick_locked(cbuf_t *q){
+  if (q->ncls == 1) return 0;
+  for (;;){
+    cring_t *r = &q->ring[q->cur];
+    if (ring_ready(q, r)){
+      if (q->sched == SCHED_DRR){
+        if (q->fresh){ r->deficit += r->weight; q->fresh = 0; }
+        if (r->deficit >= 1.0){ r->deficit -= 1.0; return q->cur; }
+      } else if (r->served < (int)r->weight){
+        r->served++;
+        return q->cur;
+      }
+    } else {
+      r->deficit = 0;
+    }
+    r->served = 0;
+    q->cur = (q->cur + 1) % q->ncls;
+    q->fresh = 1;
+  }
+}
+
+// Retira o próximo item; *from recebe o anel de origem (o chamador devolve a
+// vaga em sem_empty) ou NULL se veio do spill. O anel só recebe itens com o
+// spill vazio, então tudo que está nele é mais antigo que o spill: drenar o anel
+// antes mantém a ordem FIFO.
+static item_t cbuf_take_locked(cbuf_t *q, cring_t **from){
+  if (q->spill && ring_occ(&q->ring[0]) == 0){
+    item_t x = q->spill[q->spill_rd++];
+    x.spilled = 1;
+    atomic_fetch_sub_explicit(&q->spill_occ, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&q->occ, 1, memory_order_relaxed);
+    if (q->spill_rd == q->spill_wr){
+      q->spill_rd = q->spill_wr = 0;
+      q->spill_active_ns += now_ns() - q->spill_since;
+      pthread_cond_broadcast(&q->ring[0].bp_cv); // produtores esperando espaço no arquivo
+    }
+    *from = NULL;
+    return x;
+  }
+  cring_t *r = &q->ring[sched_pick_locked(q)];
+  item_t x = r->buf[r->head];
+  r->head = (r->head + 1) % r->cap;
+  int occ = atomic_fetch_sub_explicit(&r->occ, 1, memory_order_relaxed) - 1;
+  atomic_fetch_sub_explicit(&q->occ, 1, memory_order_relaxed);
+  if (occ <= r->lwm) pthread_cond_broadcast(&r->bp_cv);
+  *from = r;
+  return x;
+}
+
+// Inserção com spill ativo (nunca espera o HWM): vai para o anel se o spill está
+// vazio e a ocupação abaixo do HWM; senão é anexada ao arquivo. Só bloqueia com o
+// arquivo cheio, até os consumidores o esvaziarem. Retorna o tempo bloqueado.
+static long long spill_push(cbuf_t *q, item_t x){
+  cring_t *r = &q->ring[0];
+  long long waited = 0;
+  x.spilled = 0;
+  pthread_mutex_lock(&q->mtx);
+  for (;;){
+    if (q->spill_rd == q->spill_wr && ring_occ(r) < r->hwm && sem_trywait(&r->sem_empty) == 0){
+      ring_put_locked(q, r, x);
+      break;
+    }
+    if (q->spill_wr < q->spill_cap){
+      note_arrival_locked(q, &x);
+      if (q->spill_rd == q->spill_wr) q->spill_since = x.enq_ns;
+      q->spill[q->spill_wr++] = x;
+      if (x.id >= 0) q->spill_total++;
+      long o = atomic_fetch_add_explicit(&q->spill_occ, 1, memory_order_relaxed) + 1;
+      if (o > q->spill_max) q->spill_max = o;
+      atomic_fetch_add_explicit(&q->occ, 1, memory_order_relaxed);
+      break;
+    }
+    long long t0 = now_ns();
+    pthread_cond_wait(&r->bp_cv, &q->mtx);
+    waited += now_ns() - t0;
+  }
+  pthread_mutex_unlock(&q->mtx);
+  sem_post(&q->sem_full);
+  return waited;
 }
 
 static void cbuf_push(cbuf_t *q, item_t x){
-  sem_wait(&q->sem_empty);
+  if (q->spill){ spill_push(q, x); return; }
+  cring_t *r = &q->ring[x.cls];
+  sem_wait(&r->sem_empty);
   pthread_mutex_lock(&q->mtx);
-  q->buf[q->tail] = x;
-  q->tail = (q->tail + 1) % q->cap;
-  q->occ++;
-  if (q->occ <= q->lwm) pthread_cond_broadcast(&q->bp_cv);
+  ring_put_locked(q, r, x);
   pthread_mutex_unlock(&q->mtx);
   sem_post(&q->sem_full);
 }
-static item_t cbuf_pop(cbuf_t *q){
-  sem_wait(&q->sem_full);
+
+// ---------- inserção sem bloqueio (políticas de descarte) ----------
+// drop-newest: 1 se inseriu, 0 se o anel da classe estava cheio
+static int cbuf_try_push(cbuf_t *q, item_t x){
+  cring_t *r = &q->ring[x.cls];
+  if (sem_trywait(&r->sem_empty) != 0) return 0;
   pthread_mutex_lock(&q->mtx);
-  item_t x = q->buf[q->head];
-  q->head = (q->head + 1) % q->cap;
-  q->occ--;
-  if (q->occ <= q->lwm) pthread_cond_broadcast(&q->bp_cv);
+  ring_put_locked(q, r, x);
   pthread_mutex_unlock(&q->mtx);
-  sem_post(&q->sem_empty);
-  return x;
+  sem_post(&q->sem_full);
+  return 1;
+}
+
+// drop-oldest: com o anel da classe cheio sobrescreve a cabeça (o item mais
+// antigo da mesma classe sai, o novo entra no fim). sem_full não muda.
+// Retorna 0 (inseriu), 1 (inseriu e descartou o mais antigo) ou -1 (recusou:
+// a cabeça é uma pílula, que nunca é descartada).
+static int cbuf_push_overwrite(cbuf_t *q, item_t x){
+  cring_t *r = &q->ring[x.cls];
+  for (;;){
+    if (cbuf_try_push(q, x)) return 0;
+    pthread_mutex_lock(&q->mtx);
+    if (ring_occ(r) == r->cap){
+      if (r->buf[r->head].id < 0){ pthread_mutex_unlock(&q->mtx); return -1; }
+      r->head = (r->head + 1) % r->cap;
+      note_arrival_locked(q, &x);
+      r->buf[r->tail] = x;
+      r->tail = (r->tail + 1) % r->cap;
+      pthread_mutex_unlock(&q->mtx);
+      return 1;
+    }
+    pthread_mutex_unlock(&q->mtx);
+    // um consumidor liberou a vaga mas ainda não fez sem_post(empty)
+    sched_yield();
+  }
+}
+
+// ---------- token bucket (modo controlador) ----------
+// Compartilhado por todos os produtores. Cada item reserva 1 token; se o saldo
+// fica negativo o produtor dorme o tempo necessário para cobrir a dívida à taxa
+// atual (reserva => ordem FIFO entre produtores, sem busy-wait).
+typedef struct {
+  pthread_mutex_t mtx;
+  double rate;     // tokens/s (escrito pelo controlador)
+  double tokens;   // saldo atual
+  double burst;    // saldo máximo acumulável
+  long long last_ns;
+  _Atomic double rate_pub; // cópia de rate para leitura sem lock (telemetria)
+} tbucket_t;
+
+static void tb_init(tbucket_t *tb, double rate, double burst){
+  pthread_mutex_init(&tb->mtx, NULL);
+  tb->rate = rate; tb->burst = burst; tb->tokens = burst;
+  atomic_init(&tb->rate_pub, rate);
+  tb->last_ns = now_ns();
+}
+static void tb_set_rate(tbucket_t *tb, double rate){
+  pthread_mutex_lock(&tb->mtx);
+  long long t = now_ns();
+  tb->tokens += (t - tb->last_ns) / 1e9 * tb->rate; // credita na taxa antiga
+  if (tb->tokens > tb->burst) tb->tokens = tb->burst;
+  tb->last_ns = t;
+  tb->rate = rate;
+  atomic_store_explicit(&tb->rate_pub, rate, memory_order_relaxed);
+  pthread_mutex_unlock(&tb->mtx);
+}
+// retorna quantos ns o chamador deve esperar antes de enviar
+static long long tb_reserve(tbucket_t *tb){
+  pthread_mutex_lock(&tb->mtx);
+  long long t = now_ns();
+  tb->tokens += (t - tb->last_ns) / 1e9 * tb->rate;
+  if (tb->tokens > tb->burst) tb->tokens = tb->burst;
+  tb->last_ns = t;
+  tb->tokens -= 1.0;
+  long long wait = tb->tokens < 0 ? (long long)(-tb->tokens / tb->rate * 1e9) : 0;
+  pthread_mutex_unlock(&tb->mtx);
+  return wait;
+}
+// 1 se o bucket está limitando (saldo esgotado => há demanda acima da taxa)
+static int tb_limiting(tbucket_t *tb){
+  pthread_mutex_lock(&tb->mtx);
+  double tokens = tb->tokens + (now_ns() - tb->last_ns) / 1e9 * tb->rate;
+  pthread_mutex_unlock(&tb->mtx);
+  return tokens < 1.0;
+}
+static void sleep_ns(long long ns){
+  if (ns <= 0) return;
+  struct timespec ts = { .tv_sec = ns/1000000000LL, .tv_nsec = (long)(ns%1000000000LL) };
+  nanosleep(&ts, NULL);
 }
 
 // ---------- métricas globais ----------
+// Histograma log-linear de latência: 16 sub-faixas por potência de 2 (erro < 7%).
+#define HIST_SUB     16
+#define HIST_BUCKETS (61 * HIST_SUB)
+
+static int hist_bucket(long long v){
+  if (v < HIST_SUB) return v < 0 ? 0 : (int)v;
+  int msb = 63 - __builtin_clzll((unsigned long long)v);
+  return (msb - 3) * HIST_SUB + (int)((v >> (msb - 4)) & (HIST_SUB - 1));
+}
+static long long hist_upper(int b){ // limite superior (inclusivo) da faixa b
+  if (b < HIST_SUB) return b;
+  int msb = b / HIST_SUB + 3;
+  return ((long long)(HIST_SUB + b % HIST_SUB + 1) << (msb - 4)) - 1;
+}
+// percentil q em ms; max_ns limita o topo da faixa (a faixa é mais larga que o máximo real)
+static double hist_pct_ms(atomic_long *h, double q, long long max_ns){
+  long total = 0;
+  for (int b=0;b<HIST_BUCKETS;b++) total += atomic_load_explicit(&h[b], memory_order_relaxed);
+  if (total == 0) return 0.0;
+  long target = (long)(q * total); if (target >= total) target = total - 1;
+  long acc = 0;
+  for (int b=0;b<HIST_BUCKETS;b++){
+    acc += atomic_load_explicit(&h[b], memory_order_relaxed);
+    if (acc > target) return (hist_upper(b) < max_ns ? hist_upper(b) : max_ns) / 1e6;
+  }
+  return 0.0;
+}
+
 typedef struct {
-  atomic_long produced;
+  atomic_long offered;  // itens gerados pelos produtores (aceitos + recusados)
+  atomic_long produced; // itens que entraram no buffer
   atomic_long consumed;
-  atomic_long dropped; // reservado
+  atomic_long dropped;  // recusados na entrada ou expulsos (drop-oldest)
+  atomic_long evicted;  // drop-oldest: entraram (contam em produced) e foram expulsos
   atomic_llong enq_wait_ns;  // tempo esperando vaga (sem_wait empty)
   atomic_llong deq_wait_ns;  // tempo esperando item (sem_wait full)
   atomic_llong buf_lat_ns;   // latência no buffer (pop - enq)
+  atomic_llong bp_wait_ns;   // tempo retido pelo backpressure (histerese ou token bucket)
+  atomic_llong max_lat_ns;
+  atomic_long lat_hist[HIST_BUCKETS]; // latência no buffer (ns)
+  // por classe de prioridade
+  atomic_long cls_offered[MAX_CLASSES], cls_consumed[MAX_CLASSES], cls_dropped[MAX_CLASSES];
+  atomic_llong cls_max_lat_ns[MAX_CLASSES];
+  atomic_long cls_hist[MAX_CLASSES][HIST_BUCKETS];
+  // itens que passaram pelo spill (latência ponta a ponta, incluindo o disco)
+  atomic_long spill_consumed;
+  atomic_llong spill_max_lat_ns;
+  atomic_long spill_hist[HIST_BUCKETS];
+  atomic_long batches;       // retiradas com ao menos um item de dados
+  // desde o horário agendado: inclui backpressure, token bucket e espera por vaga
+  atomic_llong int_lat_ns, int_max_lat_ns;
+  atomic_long int_hist[HIST_BUCKETS];
+  atomic_llong busy_ns;      // tempo processando (custo dos lotes), todos os consumidores
 } metrics_t;
 
+// slot de consumidor: criado sob demanda, estacionado e reativado pelo scaler
+typedef struct {
+  pthread_t th;
+  int created;
+  int parked;            // protegido por pool_mtx
+  pthread_cond_t cv;
+} cslot_t;
+
 typedef struct {
   config_t cfg;
   cbuf_t q;
-  pthread_t *prod, *cons;
+  pthread_t *prod;
+  cslot_t *cons;             // cons_max slots; os C primeiros começam ativos
+  pthread_mutex_t pool_mtx;
+  int park_pending;          // pílulas PARK no buffer ainda não retiradas (pool_mtx)
+  atomic_int active_cons;
+  atomic_llong cons_active_ns; // consumidor-thread-ns ativos (fora do estacionamento)
+  pthread_t scaler;
   pthread_t sampler;
+  pthread_t controller;
+  tbucket_t tb;
   atomic_int stop;
   atomic_long next_id;
   metrics_t m;
-  // série temporal ocupação
-  int sample_ms;
+  // série temporal ocupação (em memória só sem --telemetry)
   int max_samples;
   int samples_count;
-  struct { int t_ms; int occ; } *samples;
+  struct { long long t_us; int occ; double rate; int cons; long spill; } *samples;
+  // replay de trace
+  const char *trace;        // arquivo mapeado (somente leitura)
+  size_t trace_len;
+  double trace_t_first;     // timestamp da 1ª chegada (origem do replay)
+  long long replay_t0;      // instante (CLOCK_MONOTONIC) que corresponde à origem
+  atomic_int producers_done;
+  atomic_long replay_arrivals;
+  long trace_invalid;       // linhas inválidas (contadas só pelo produtor 0)
+  size_t trace_bad_pos;     // onde termina a primeira delas (para achar o nº da linha)
+  atomic_llong replay_lag_ns, replay_max_lag_ns; // atraso em relação ao agendado
+  // estatística incremental da ocupação (Welford), escrita só pelo sampler
+  long long occ_n;
+  double occ_mean, occ_m2;
+  int tlog_failed;          // --telemetry: escrita falhou e a série foi interrompida
+  // tempo de serviço por item (Welford), juntado pelos consumidores ao sair (pool_mtx)
+  long svc_n;
+  double svc_mean, svc_m2;
 } ctx_t;
 
 static ctx_t G;
 
-// helpers atômicos p/ add em atomic_llong
+// helpers atômicos p/ add e máximo em atomic_llong
 static inline void add_ll(atomic_llong *dst, long long v){
   atomic_fetch_add_explicit(dst, v, memory_order_relaxed);
 }
+static inline void max_ll(atomic_llong *dst, long long v){
+  long long mx = atomic_load_explicit(dst, memory_order_relaxed);
+  while (v > mx && !atomic_compare_exchange_weak_explicit(dst, &mx, v,
+                       memory_order_relaxed, memory_order_relaxed)) {}
+}
 
 // wrappers que medem espera (usam semáforos + acumuladores atômicos)
 static void cbuf_push_timed(cbuf_t *q, item_t x, atomic_llong *enq_wait){
+  if (q->spill){ add_ll(enq_wait, spill_push(q, x)); return; }
+  cring_t *r = &q->ring[x.cls];
   long long t0 = now_ns();
-  sem_wait(&q->sem_empty);
+  sem_wait(&r->sem_empty);
   add_ll(enq_wait, now_ns() - t0);
 
   pthread_mutex_lock(&q->mtx);
-  q->buf[q->tail] = x;
-  q->tail = (q->tail + 1) % q->cap;
-  q->occ++;
-  if (q->occ <= q->lwm) pthread_cond_broadcast(&q->bp_cv);
+  ring_put_locked(q, r, x);
   pthread_mutex_unlock(&q->mtx);
   sem_post(&q->sem_full);
 }
 
-static item_t cbuf_pop_timed(cbuf_t *q, atomic_llong *deq_wait){
+// Retira até k itens numa única seção crítica: espera só pelo primeiro
+// (sem_wait) e reserva os demais se já estiverem no buffer (sem_trywait).
+static int cbuf_pop_batch(cbuf_t *q, item_t *out, int k, atomic_llong *deq_wait){
   long long t0 = now_ns();
   sem_wait(&q->sem_full);
   add_ll(deq_wait, now_ns() - t0);
+  int n = 1;
+  while (n < k && sem_trywait(&q->sem_full) == 0) n++;
 
+  cring_t *from[MAX_BATCH];
   pthread_mutex_lock(&q->mtx);
-  item_t x = q->buf[q->head];
-  q->head = (q->head + 1) % q->cap;
-  q->occ--;
-  if (q->occ <= q->lwm) pthread_cond_broadcast(&q->bp_cv);
+  for (int i=0;i<n;i++) out[i] = cbuf_take_locked(q, &from[i]);
   pthread_mutex_unlock(&q->mtx);
-  sem_post(&q->sem_empty);
-  return x;
+  for (int i=0;i<n;i++) if (from[i]) sem_post(&from[i]->sem_empty);
+  return n;
+}
+
+// ---------- entrada conforme a política de descarte ----------
+// Retorna 1 se o item entrou no buffer. Descartes somam em m.dropped.
+static int offer_item(ctx_t *C, item_t it, unsigned *seed, long *above_hwm){
+  cbuf_t *q = &C->q;
+  cring_t *r = &q->ring[it.cls];
+  int ok;
+  atomic_fetch_add_explicit(&C->m.cls_offered[it.cls], 1, memory_order_relaxed);
+  switch (C->cfg.drop){
+    case DROP_BLOCK:
+      cbuf_push_timed(q, it, &C->m.enq_wait_ns);
+      return 1;
+    case DROP_OLDEST: {
+      int res = cbuf_push_overwrite(q, it);
+      if (res > 0) atomic_fetch_add_explicit(&C->m.evicted, 1, memory_order_relaxed);
+      if (res != 0){
+        atomic_fetch_add_explicit(&C->m.dropped, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&C->m.cls_dropped[it.cls], 1, memory_order_relaxed);
+      }
+      return res >= 0;
+    }
+    case DROP_RED: {
+      // descarte precoce: prob. cresce linearmente de 0 (LWM) a maxp (HWM); >= HWM descarta
+      int occ = ring_occ(r);
+      double p = 0.0;
+      if (occ >= r->hwm) p = 1.0;
+      else if (occ > r->lwm) p = C->cfg.red_maxp * (occ - r->lwm) / (double)(r->hwm - r->lwm);
+      ok = (p <= 0.0 || rand_r(seed) / ((double)RAND_MAX + 1.0) >= p) && cbuf_try_push(q, it);
+      break;
+    }
+    case DROP_SAMPLE:
+      // acima do HWM só 1 a cada k itens tenta entrar
+      ok = (ring_occ(r) < r->hwm || (++*above_hwm % C->cfg.sample_k) == 0) && cbuf_try_push(q, it);
+      break;
+    default: // DROP_NEWEST
+      ok = cbuf_try_push(q, it);
+      break;
+  }
+  if (!ok){
+    atomic_fetch_add_explicit(&C->m.dropped, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&C->m.cls_dropped[it.cls], 1, memory_order_relaxed);
+  }
+  return ok;
+}
+
+// ---------- backpressure do lado do produtor ----------
+// histerese: se a ocupação da classe >= HWM, aguarda cair abaixo de LWM (só na política block)
+static void bp_hyst_wait(ctx_t *C, int cls){
+  if (C->cfg.bp != BP_HYST || C->cfg.drop != DROP_BLOCK || C->q.spill) return;
+  cring_t *r = &C->q.ring[cls];
+  long long b0 = now_ns();
+  pthread_mutex_lock(&C->q.mtx);
+  while (ring_occ(r) >= r->hwm &&
+         !atomic_load_explicit(&C->stop, memory_order_relaxed)){
+    pthread_cond_wait(&r->bp_cv, &C->q.mtx);
+  }
+  pthread_mutex_unlock(&C->q.mtx);
+  add_ll(&C->m.bp_wait_ns, now_ns() - b0);
+}
+// modo controlador: cada item consome um token
+static void bp_token_wait(ctx_t *C){
+  if (C->cfg.bp == BP_HYST) return;
+  long long w = tb_reserve(&C->tb);
+  sleep_ns(w);
+  add_ll(&C->m.bp_wait_ns, w);
+}
+
+// classe de um item sintético, sorteada pela --class-mix
+static int pick_class(const config_t *cf, unsigned *seed){
+  if (cf->classes == 1) return 0;
+  double u = rand_r(seed) / ((double)RAND_MAX + 1.0);
+  for (int k=0;k<cf->classes-1;k++){
+    if (u < cf->cls_mix[k]) return k;
+    u -= cf->cls_mix[k];
+  }
+  return cf->classes - 1;
 }
 
 // ---------- produtores com BURSTS + BACKPRESSURE ----------
@@ -196,112 +949,645 @@ static void *producer(void *arg){
   ctx_t *C = &G;
   unsigned seed = (unsigned)(time(NULL) ^ (pid*2654435761u));
   int burst = C->cfg.burst_size;
+  long above_hwm = 0; // contador da amostragem 1-em-k
+
+  int multi = C->cfg.classes > 1;
+  // Agenda de chegadas: o próximo horário avança pelo jitter/ociosidade sorteados,
+  // não pelo relógio depois das esperas. Produtor retido pelo backpressure fica
+  // atrás da agenda, envia sem dormir até alcançá-la, e cada item carrega o
+  // horário agendado (intended_ns) para a latência medida a partir dele.
+  long long sched = now_ns();
 
   while (!atomic_load_explicit(&C->stop, memory_order_relaxed)){
-    // BACKPRESSURE: se ocupação >= HWM, aguarda cair abaixo de LWM
-    pthread_mutex_lock(&C->q.mtx);
-    while (C->q.occ >= C->q.hwm &&
-           !atomic_load_explicit(&C->stop, memory_order_relaxed)){
-      pthread_cond_wait(&C->q.bp_cv, &C->q.mtx);
-    }
-    pthread_mutex_unlock(&C->q.mtx);
+    if (!multi) bp_hyst_wait(C, 0);
 
-    // Rajada de B itens "rápidos"
+    // Rajada de B itens "rápidos"; com classes a histerese vale por item, para a
+    // classe cheia não reter as demais
     for (int k=0; k<burst &&
                  !atomic_load_explicit(&C->stop, memory_order_relaxed); k++){
       item_t it;
+      it.cls = pick_class(&C->cfg, &seed);
+      if (multi){
+        bp_hyst_wait(C, it.cls);
+        if (atomic_load_explicit(&C->stop, memory_order_relaxed)) break;
+      }
+      sched += (rand_r(&seed) % 3) * 1000000LL; // jitter 0..2 ms
+      sleep_until_ns(sched);
+      bp_token_wait(C);
       it.id = atomic_fetch_add_explicit(&C->next_id, 1, memory_order_relaxed) + 1;
-      it.enq_ns = now_ns();
-      int jitter = rand_r(&seed) % 3; // 0..2 ms
-      if (jitter) sleep_ms(jitter);
-      cbuf_push_timed(&C->q, it, &C->m.enq_wait_ns);
-      atomic_fetch_add_explicit(&C->m.produced, 1, memory_order_relaxed);
+      it.intended_ns = sched;
+      atomic_fetch_add_explicit(&C->m.offered, 1, memory_order_relaxed);
+      if (offer_item(C, it, &seed, &above_hwm)){
+        atomic_fetch_add_explicit(&C->m.produced, 1, memory_order_relaxed);
+      }
       if ((k & 7)==0) sched_yield();
     }
 
     // Ociosidade após a rajada
-    sleep_ms(C->cfg.idle_ms);
+    sched += (long long)C->cfg.idle_ms * 1000000LL;
+    sleep_until_ns(sched);
   }
   return NULL;
 }
 
+// ---------- replay de trace ----------
+// Formato: uma chegada por linha, "timestamp [itens [classe]]" (separador espaço,
+// tab ou vírgula; '#' comenta; sem classe => sorteada pela --class-mix). Timestamps crescentes, na unidade de --trace-unit;
+// o primeiro é a origem. O arquivo é mapeado com mmap e lido sem cópia. Linhas
+// inválidas (cabeçalho CSV incluso) são puladas e contadas no resumo.
+
+// Lê a próxima chegada a partir de *pos. Retorna 1 (ok), 0 (fim) ou -1 (linha inválida).
+static int trace_next(const char *d, size_t len, size_t *pos, double *ts, long *items, int *cls){
+  size_t i = *pos;
+  for (;;){
+    while (i < len && (d[i]==' ' || d[i]=='\t' || d[i]=='\r' || d[i]=='\n')) i++;
+    if (i >= len){ *pos = i; return 0; }
+    if (d[i] != '#') break;
+    while (i < len && d[i] != '\n') i++;
+  }
+  double v = 0.0; int digits = 0;
+  while (i < len && d[i] >= '0' && d[i] <= '9'){ v = v*10 + (d[i]-'0'); i++; digits++; }
+  if (i < len && d[i] == '.'){
+    double scale = 0.1; i++;
+    while (i < len && d[i] >= '0' && d[i] <= '9'){ v += (d[i]-'0')*scale; scale *= 0.1; i++; digits++; }
+  }
+  long n = 1;
+  while (i < len && (d[i]==' ' || d[i]=='\t' || d[i]==',')) i++;
+  if (i < len && d[i] >= '0' && d[i] <= '9'){
+    n = 0;
+    while (i < len && d[i] >= '0' && d[i] <= '9'){ n = n*10 + (d[i]-'0'); i++; }
+  }
+  int c = -1;
+  while (i < len && (d[i]==' ' || d[i]=='\t' || d[i]==',')) i++;
+  if (i < len && d[i] >= '0' && d[i] <= '9'){
+    c = 0;
+    while (i < len && d[i] >= '0' && d[i] <= '9'){ if (c < 1000) c = c*10 + (d[i]-'0'); i++; }
+  }
+  while (i < len && (d[i]==' ' || d[i]=='\t' || d[i]=='\r')) i++;
+  int ok = digits > 0 && (i >= len || d[i] == '\n' || d[i] == '#');
+  while (i < len && d[i] != '\n') i++;
+  *pos = i;
+  *ts = v; *items = n; *cls = c;
+  return ok ? 1 : -1;
+}
+
+static int trace_open(ctx_t *C, const char *path){
+  int fd = open(path, O_RDONLY);
+  if (fd < 0){ perror(path); return -1; }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0){
+    fprintf(stderr, "%s: trace vazio\n", path); close(fd); return -1;
+  }
+  void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED){ perror("mmap"); return -1; }
+  madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+  C->trace = p; C->trace_len = (size_t)st.st_size;
+
+  // linhas inválidas antes da primeira chegada (ex.: cabeçalho CSV) são
+  // ignoradas como as demais; o produtor 0 as conta e o resumo as reporta
+  size_t pos = 0; double ts; long n; int cls;
+  int r;
+  while ((r = trace_next(C->trace, C->trace_len, &pos, &ts, &n, &cls)) < 0) {}
+  if (r != 1){
+    fprintf(stderr, "%s: sem chegadas válidas\n", path);
+    munmap(p, C->trace_len); C->trace = NULL;
+    return -1;
+  }
+  C->trace_t_first = ts;
+  return 0;
+}
+
+// Produtor p reproduz as chegadas i com i % P == p. Cada chegada dorme até o
+// prazo absoluto replay_t0 + (ts - ts0)/speed e então oferta seus itens.
+static void *trace_producer(void *arg){
+  long pid = (long)arg;
+  ctx_t *C = &G;
+  unsigned seed = (unsigned)(time(NULL) ^ (pid*2654435761u));
+  long above_hwm = 0;
+  size_t pos = 0;
+  long idx = 0;
+  double ts; long n; int cls;
+  int r;
+
+  while (!atomic_load_explicit(&C->stop, memory_order_relaxed) &&
+         (r = trace_next(C->trace, C->trace_len, &pos, &ts, &n, &cls)) != 0){
+    if (r < 0){ // linha inválida: ignorada, contada uma vez
+      if (pid == 0 && C->trace_invalid++ == 0) C->trace_bad_pos = pos;
+      continue;
+    }
+    if ((idx++ % C->cfg.P) != pid) continue; // de outro produtor
+    long long due = C->replay_t0 +
+                    (long long)((ts - C->trace_t_first) * C->cfg.trace_unit_ns / C->cfg.speed);
+    sleep_until_ns(due);
+
+    long long lag = now_ns() - due;
+    add_ll(&C->replay_lag_ns, lag);
+    max_ll(&C->replay_max_lag_ns, lag);
+    atomic_fetch_add_explicit(&C->replay_arrivals, 1, memory_order_relaxed);
+
+    if (cls >= C->cfg.classes) cls = C->cfg.classes - 1;
+    for (long k=0; k<n && !atomic_load_explicit(&C->stop, memory_order_relaxed); k++){
+      item_t it;
+      it.cls = cls >= 0 ? cls : pick_class(&C->cfg, &seed);
+      if (k == 0 || C->cfg.classes > 1) bp_hyst_wait(C, it.cls);
+      bp_token_wait(C);
+      it.id = atomic_fetch_add_explicit(&C->next_id, 1, memory_order_relaxed) + 1;
+      it.intended_ns = due;
+      atomic_fetch_add_explicit(&C->m.offered, 1, memory_order_relaxed);
+      if (offer_item(C, it, &seed, &above_hwm)){
+        atomic_fetch_add_explicit(&C->m.produced, 1, memory_order_relaxed);
+      }
+    }
+  }
+  atomic_fetch_add_explicit(&C->producers_done, 1, memory_order_relaxed);
+  return NULL;
+}
+
 // ---------- consumidores ----------
+// Estaciona o slot até o scaler reativá-lo. Retorna 0 se foi acordado para encerrar.
+static int consumer_park(ctx_t *C, cslot_t *sl, long long *active_since){
+  add_ll(&C->cons_active_ns, now_ns() - *active_since);
+  pthread_mutex_lock(&C->pool_mtx);
+  C->park_pending--;
+  sl->parked = 1;
+  atomic_fetch_sub_explicit(&C->active_cons, 1, memory_order_relaxed);
+  while (sl->parked && !atomic_load_explicit(&C->stop, memory_order_relaxed))
+    pthread_cond_wait(&sl->cv, &C->pool_mtx);
+  int resumed = !sl->parked;
+  pthread_mutex_unlock(&C->pool_mtx);
+  *active_since = now_ns();
+  return resumed;
+}
+
+// latência de um item retirado em t: no buffer (retirada - enfileiramento) e
+// desde o horário agendado (retirada - intended_ns)
+static void record_item(ctx_t *C, item_t it, long long t){
+  long long di = t - it.intended_ns;
+  add_ll(&C->m.int_lat_ns, di);
+  atomic_fetch_add_explicit(&C->m.int_hist[hist_bucket(di)], 1, memory_order_relaxed);
+  max_ll(&C->m.int_max_lat_ns, di);
+
+  long long dt = t - it.enq_ns;
+  int b = hist_bucket(dt);
+  add_ll(&C->m.buf_lat_ns, dt);
+  atomic_fetch_add_explicit(&C->m.lat_hist[b], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&C->m.cls_hist[it.cls][b], 1, memory_order_relaxed);
+  max_ll(&C->m.max_lat_ns, dt);
+  max_ll(&C->m.cls_max_lat_ns[it.cls], dt);
+  atomic_fetch_add_explicit(&C->m.consumed, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&C->m.cls_consumed[it.cls], 1, memory_order_relaxed);
+  if (it.spilled){
+    atomic_fetch_add_explicit(&C->m.spill_hist[b], 1, memory_order_relaxed);
+    max_ll(&C->m.spill_max_lat_ns, dt);
+    atomic_fetch_add_explicit(&C->m.spill_consumed, 1, memory_order_relaxed);
+  }
+}
+
+// junta as estatísticas locais de serviço do consumidor às globais
+static void svc_publish(ctx_t *C, long n, double mean, double m2){
+  pthread_mutex_lock(&C->pool_mtx);
+  welford_merge(&C->svc_n, &C->svc_mean, &C->svc_m2, n, mean, m2);
+  pthread_mutex_unlock(&C->pool_mtx);
+}
+
+// Cada retirada traz até cfg.batch itens e custa cost_batch_us + n*cost_item_us
+// (ex.: escrita em lote num banco). Pílulas no meio do lote: PARK estaciona
+// depois de processar o lote (pílulas PARK extras voltam ao buffer se houver
+// vaga; senão são descartadas e saem de park_pending); a poison
+// pill volta ao buffer e o consumidor sai ao fim do lote.
 static void *consumer(void *arg){
-  (void)arg;
   ctx_t *C = &G;
+  cslot_t *sl = &C->cons[(long)arg];
+  long long active_since = now_ns();
+  item_t batch[MAX_BATCH];
+  long svc_n = 0; double svc_mean = 0, svc_m2 = 0; // serviço por item (lote / n)
   for (;;){
-    item_t it = cbuf_pop_timed(&C->q, &C->m.deq_wait_ns);
-    if (it.id < 0){ // poison pill
-      cbuf_push(&C->q, it); // deixa outra thread ver
-      break;
+    int n = cbuf_pop_batch(&C->q, batch, C->cfg.batch, &C->m.deq_wait_ns);
+    long long t = now_ns();
+    int items = 0, park = 0, quit = 0;
+    for (int i=0;i<n;i++){
+      item_t it = batch[i];
+      if (it.id == PARK_ID){
+        // no encerramento ignora: quem está ativo drena o buffer até a poison pill
+        if (atomic_load_explicit(&C->stop, memory_order_relaxed)) continue;
+        // outro consumidor estaciona; sem vaga (produtores encheram o anel) a
+        // pílula extra some: bloquear aqui travaria quem drena o buffer
+        if (park && !cbuf_try_push(&C->q, it)){
+          pthread_mutex_lock(&C->pool_mtx);
+          C->park_pending--;
+          pthread_mutex_unlock(&C->pool_mtx);
+        }
+        park = 1;
+        continue;
+      }
+      if (it.id < 0){ // poison pill
+        cbuf_push(&C->q, it); // deixa outra thread ver
+        quit = 1;
+        continue;
+      }
+      record_item(C, it, t);
+      items++;
+    }
+    if (items){
+      atomic_fetch_add_explicit(&C->m.batches, 1, memory_order_relaxed);
+      long long s0 = now_ns();
+      sleep_ns((long long)((C->cfg.cost_batch_us + items * C->cfg.cost_item_us) * 1000.0));
+      long long busy = now_ns() - s0;
+      add_ll(&C->m.busy_ns, busy);
+      welford_merge(&svc_n, &svc_mean, &svc_m2, items, busy / (double)items, 0);
+    }
+    if (quit) break;
+    if (park && !consumer_park(C, sl, &active_since)){
+      svc_publish(C, svc_n, svc_mean, svc_m2);
+      return NULL;
+    }
+  }
+  svc_publish(C, svc_n, svc_mean, svc_m2);
+  add_ll(&C->cons_active_ns, now_ns() - active_since);
+  return NULL;
+}
+
+// ---------- pool elástico ----------
+// Reativa um slot estacionado ou cria uma thread nova (chamar com pool_mtx).
+static int pool_grow_locked(ctx_t *C){
+  for (int i=0;i<C->cfg.cons_max;i++){
+    if (C->cons[i].created && C->cons[i].parked){
+      C->cons[i].parked = 0;
+      atomic_fetch_add_explicit(&C->active_cons, 1, memory_order_relaxed);
+      pthread_cond_signal(&C->cons[i].cv);
+      return 1;
+    }
+  }
+  for (long i=0;i<C->cfg.cons_max;i++){
+    if (!C->cons[i].created){
+      if (pthread_create(&C->cons[i].th, NULL, consumer, (void*)i) != 0) return 0;
+      C->cons[i].created = 1;
+      atomic_fetch_add_explicit(&C->active_cons, 1, memory_order_relaxed);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Acima do HWM por scale_window_ms contínuos => +1 consumidor; abaixo do LWM
+// pela mesma janela => envia uma pílula PARK (o consumidor que a retirar
+// estaciona). Após cada ação a janela recomeça (cooldown implícito).
+static void *scaler(void *arg){
+  (void)arg;
+  ctx_t *C = &G;
+  const long long window = (long long)C->cfg.scale_window_ms * 1000000LL;
+  int tick_ms = C->cfg.scale_window_ms / 10;
+  if (tick_ms < 1) tick_ms = 1;
+  long long above_since = 0, below_since = 0;
+
+  while (!atomic_load_explicit(&C->stop, memory_order_relaxed)){
+    sleep_ms(tick_ms);
+    int occ = cbuf_occ(&C->q);
+    long long t = now_ns();
+    if (occ >= C->q.hwm){
+      below_since = 0;
+      if (!above_since) above_since = t;
+      if (t - above_since >= window){
+        pthread_mutex_lock(&C->pool_mtx);
+        pool_grow_locked(C);
+        pthread_mutex_unlock(&C->pool_mtx);
+        above_since = t;
+      }
+    } else if (occ <= C->q.lwm){
+      above_since = 0;
+      if (!below_since) below_since = t;
+      if (t - below_since >= window){
+        pthread_mutex_lock(&C->pool_mtx);
+        int effective = atomic_load(&C->active_cons) - C->park_pending;
+        if (effective > C->cfg.cons_min){
+          item_t park = {.id = PARK_ID, .intended_ns = t, .cls = C->cfg.classes - 1};
+          if (cbuf_try_push(&C->q, park)) C->park_pending++;
+        }
+        pthread_mutex_unlock(&C->pool_mtx);
+        below_since = t;
+      }
+    } else {
+      above_since = below_since = 0;
     }
-    long long dt = now_ns() - it.enq_ns;
-    add_ll(&C->m.buf_lat_ns, dt);
-    atomic_fetch_add_explicit(&C->m.consumed, 1, memory_order_relaxed);
-    sleep_ms(2); // custo de consumo
   }
   return NULL;
 }
 
+// ---------- telemetria em arquivo ----------
+// Escritor com buffer grande (stdio) e rotação por tamanho: ARQ.0, ARQ.1, ...
+// (sem --rotate-mb grava direto em ARQ). Cada segmento começa com o cabeçalho.
+// Com --rotate-keep K, abrir o segmento seq apaga ARQ.(seq-K): o disco fica
+// limitado a ~K*MB em execuções longas. Erro de escrita (disco cheio) encerra
+// a telemetria com mensagem; a execução segue.
+#define TLOG_HEADER "t_us,occ,rate,prod_it_s,cons_it_s,drop_it_s,enq_wait_ms,deq_wait_ms,consumers\n"
+#define TLOG_IOBUF  (1 << 20)
+
+typedef struct {
+  FILE *f;
+  char *iobuf;
+  int seq;
+  long long bytes;
+  char path[4096];  // segmento atual (para mensagens de erro)
+} tlog_t;
+
+static int tlog_open_segment(tlog_t *tl, const config_t *cf){
+  if (cf->rotate_bytes > 0) snprintf(tl->path, sizeof tl->path, "%s.%d", cf->telemetry_path, tl->seq);
+  else snprintf(tl->path, sizeof tl->path, "%s", cf->telemetry_path);
+  tl->f = fopen(tl->path, "w");
+  if (!tl->f){ perror(tl->path); return -1; }
+  setvbuf(tl->f, tl->iobuf, _IOFBF, TLOG_IOBUF);
+  if (fputs(TLOG_HEADER, tl->f) < 0){ perror(tl->path); fclose(tl->f); tl->f = NULL; return -1; }
+  tl->bytes = (long long)strlen(TLOG_HEADER);
+  if (cf->rotate_bytes > 0 && cf->rotate_keep > 0 && tl->seq >= cf->rotate_keep){
+    char old[4096];
+    snprintf(old, sizeof old, "%s.%d", cf->telemetry_path, tl->seq - cf->rotate_keep);
+    if (unlink(old) != 0 && errno != ENOENT) perror(old);
+  }
+  return 0;
+}
+
+// fecha o segmento; -1 se o fclose achou erro pendente (ex.: flush com disco cheio)
+static int tlog_close(tlog_t *tl){
+  int rc = fclose(tl->f);
+  tl->f = NULL;
+  if (rc != 0){ perror(tl->path); return -1; }
+  return 0;
+}
+
+static int tlog_write(tlog_t *tl, const config_t *cf, const char *line, int len){
+  if (cf->rotate_bytes > 0 && tl->bytes + len > cf->rotate_bytes){
+    if (tlog_close(tl) != 0) return -1;
+    tl->seq++;
+    if (tlog_open_segment(tl, cf) != 0) return -1;
+  }
+  if (fwrite(line, 1, (size_t)len, tl->f) != (size_t)len){
+    perror(tl->path);
+    return -1;
+  }
+  tl->bytes += len;
+  return 0;
+}
+
 // ---------- sampler de ocupação ----------
+// Período com prazos absolutos (clock_nanosleep TIMER_ABSTIME): o atraso de uma
+// amostra não se acumula nas seguintes. A ocupação é lida do contador atômico,
+// sem disputar q.mtx com produtores/consumidores.
 static void *sampler(void *arg){
   (void)arg;
   ctx_t *C = &G;
+  const config_t *cf = &C->cfg;
+  const long long period_ns = (long long)cf->sample_us * 1000LL;
+  tlog_t tl = {0};
+  if (cf->telemetry_path){
+    tl.iobuf = malloc(TLOG_IOBUF);
+    if (!tl.iobuf || tlog_open_segment(&tl, cf) != 0){
+      free(tl.iobuf);
+      tl.iobuf = NULL;
+      tl.f = NULL;
+    }
+  }
+
   long long t0 = now_ns();
+  long long next = t0, last_t = t0, last_flush = t0;
+  long last_prod = 0, last_cons = 0, last_drop = 0;
+  long long last_enq = 0, last_deq = 0;
   while (!atomic_load_explicit(&C->stop, memory_order_relaxed)){
-    sleep_ms(C->sample_ms);
-    int occ;
-    pthread_mutex_lock(&C->q.mtx);
-    occ = C->q.occ;
-    pthread_mutex_unlock(&C->q.mtx);
-    int idx = C->samples_count;
-    if (idx < C->max_samples){
+    next += period_ns;
+    long long t = now_ns();
+    if (t > next + period_ns) next = t + period_ns; // atrasou demais: ressincroniza
+    struct timespec ts = { .tv_sec = next/1000000000LL, .tv_nsec = (long)(next%1000000000LL) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+
+    int occ = cbuf_occ(&C->q);
+    double rate = atomic_load_explicit(&C->tb.rate_pub, memory_order_relaxed);
+    t = now_ns();
+
+    C->occ_n++;
+    double d = occ - C->occ_mean;
+    C->occ_mean += d / C->occ_n;
+    C->occ_m2 += d * (occ - C->occ_mean);
+
+    if (tl.f){
+      long prod = atomic_load_explicit(&C->m.produced, memory_order_relaxed);
+      long cons = atomic_load_explicit(&C->m.consumed, memory_order_relaxed);
+      long drop = atomic_load_explicit(&C->m.dropped, memory_order_relaxed);
+      long long enq = atomic_load_explicit(&C->m.enq_wait_ns, memory_order_relaxed);
+      long long deq = atomic_load_explicit(&C->m.deq_wait_ns, memory_order_relaxed);
+      double dt = (t - last_t) / 1e9;
+      char line[256];
+      int len = snprintf(line, sizeof line, "%lld,%d,%.1f,%.1f,%.1f,%.1f,%.3f,%.3f,%d\n",
+                         (t - t0) / 1000LL, occ, rate,
+                         (prod - last_prod) / dt, (cons - last_cons) / dt, (drop - last_drop) / dt,
+                         prod > last_prod ? (enq - last_enq) / 1e6 / (double)(prod - last_prod) : 0.0,
+                         cons > last_cons ? (deq - last_deq) / 1e6 / (double)(cons - last_cons) : 0.0,
+                         atomic_load_explicit(&C->active_cons, memory_order_relaxed));
+      int err = tlog_write(&tl, cf, line, len) != 0;
+      last_prod = prod; last_cons = cons; last_drop = drop;
+      last_enq = enq; last_deq = deq; last_t = t;
+      if (!err && t - last_flush >= 1000000000LL){ // visível p/ tail -f
+        if (fflush(tl.f) != 0){ perror(tl.path); err = 1; }
+        last_flush = t;
+      }
+      if (err){
+        fprintf(stderr, "telemetria interrompida em t=%.3f s\n", (t - t0) / 1e9);
+        if (tl.f) fclose(tl.f);
+        tl.f = NULL;
+        C->tlog_failed = 1;
+      }
+    } else if (C->samples_count < C->max_samples){
+      int idx = C->samples_count;
       C->samples[idx].occ = occ;
-      C->samples[idx].t_ms = (int)((now_ns()-t0)/1000000LL);
+      C->samples[idx].rate = rate;
+      C->samples[idx].cons = atomic_load_explicit(&C->active_cons, memory_order_relaxed);
+      C->samples[idx].spill = atomic_load_explicit(&C->q.spill_occ, memory_order_relaxed);
+      C->samples[idx].t_us = (t - t0) / 1000LL;
       C->samples_count++;
     }
   }
+  if (tl.f && tlog_close(&tl) != 0) C->tlog_failed = 1;
+  free(tl.iobuf);
   return NULL;
 }
 
+// ---------- controlador AIMD/PID ----------
+// A cada ctl_ms mede a variável de processo (ocupação ou latência média no
+// buffer no período) e ajusta a taxa do token bucket.
+//  AIMD: abaixo do alvo soma aimd_add; acima multiplica por aimd_mul.
+//  PID:  taxa = kp*e + ki*∫e + kd*de/dt, com e = alvo - medida e anti-windup
+//        (o integrador não acumula enquanto a saída está saturada).
+// Nos dois casos a taxa só sobe quando o bucket está limitando: na ociosidade
+// entre rajadas o erro é positivo mas não há demanda, e subir a taxa ali só
+// deixaria a próxima rajada passar sem controle.
+static void *controller(void *arg){
+  (void)arg;
+  ctx_t *C = &G;
+  const config_t *cf = &C->cfg;
+  const double dt = cf->ctl_ms / 1000.0;
+  double rate = cf->rate0;
+  // integrador começa onde a taxa inicial já é a saída do PID (sem degrau)
+  double integ = cf->ki > 0 ? rate / cf->ki : 0.0;
+  double prev_err = 0.0, pv = 0.0;
+  int have_prev = 0;
+  long long last_lat = 0; long last_cons = 0;
+
+  while (!atomic_load_explicit(&C->stop, memory_order_relaxed)){
+    sleep_ms(cf->ctl_ms);
+    double target;
+    if (cf->target_lat_ms > 0){
+      long long lat = atomic_load_explicit(&C->m.buf_lat_ns, memory_order_relaxed);
+      long cons = atomic_load_explicit(&C->m.consumed, memory_order_relaxed);
+      if (cons > last_cons) pv = (lat - last_lat) / 1e6 / (double)(cons - last_cons);
+      last_lat = lat; last_cons = cons;
+      target = cf->target_lat_ms;
+    } else {
+      pv = cbuf_occ(&C->q);
+      target = cf->target_occ;
+    }
+    double err = target - pv;
+    int may_raise = tb_limiting(&C->tb);
+
+    if (cf->bp == BP_AIMD){
+      if (err <= 0) rate *= cf->aimd_mul;
+      else if (may_raise) rate += cf->aimd_add;
+    } else {
+      double deriv = have_prev ? (err - prev_err) / dt : 0.0;
+      double next_integ = integ + err * dt;
+      double u = cf->kp*err + cf->ki*next_integ + cf->kd*deriv;
+      int saturated = (u >= cf->rate_max && err > 0) || (u <= cf->rate_min && err < 0);
+      if (!saturated && (err <= 0 || may_raise)) integ = next_integ;
+      rate = cf->kp*err + cf->ki*integ + cf->kd*deriv;
+    }
+    prev_err = err; have_prev = 1;
+    if (rate < cf->rate_min) rate = cf->rate_min;
+    if (rate > cf->rate_max) rate = cf->rate_max;
+    tb_set_rate(&C->tb, rate);
+  }
+  return NULL;
+}
+
+// ---------- validação com teoria de filas ----------
+// Probabilidade de espera de Erlang C para c servidores e carga a = lambda/mu (a < c).
+static double erlang_c(int c, double a){
+  double term = 1.0, sum = 0.0; // term = a^k/k!
+  for (int k=0;k<c;k++){ sum += term; term *= a / (k + 1); }
+  double tail = term / (1.0 - a / c);
+  return tail / (sum + tail);
+}
+
+static double pct_dev(double measured, double predicted){
+  return predicted > 0 ? 100.0 * (measured - predicted) / predicted : 0.0;
+}
+
+// Compara o medido com L = lambda*W e com as previsões M/M/c e M/D/c (e G/G/c
+// por Allen-Cunneen com os coeficientes de variação medidos). A fila do modelo
+// é o buffer: Lq = ocupação média amostrada, Wq = latência média no buffer.
+// prod são os itens servidos pelo buffer: com drop-oldest, os expulsos saem
+// de lambda, já que W e L só enxergam os itens que chegaram a ser consumidos.
+static void print_queue_model(double elapsed, long prod, long cons, double wq_s, double lq){
+  double busy_s = atomic_load(&G.m.busy_ns) / 1e9;
+  double active_s = atomic_load(&G.cons_active_ns) / 1e9;
+  double lambda = elapsed > 0 ? prod / elapsed : 0.0;
+  double mu = busy_s > 0 ? cons / busy_s : 0.0;            // por consumidor
+  double c_mean = elapsed > 0 ? active_s / elapsed : 0.0;
+  int c = (int)(c_mean + 0.5); if (c < 1) c = 1;
+  double rho = mu > 0 ? lambda / (c * mu) : 0.0;
+  double ca2 = G.q.arr_n > 1 && G.q.arr_mean > 0 ? (G.q.arr_m2 / (G.q.arr_n - 1)) / (G.q.arr_mean * G.q.arr_mean) : 0.0;
+  double cs2 = G.svc_n > 1 && G.svc_mean > 0 ? (G.svc_m2 / (G.svc_n - 1)) / (G.svc_mean * G.svc_mean) : 0.0;
+
+  printf("\nmodelo de filas (c=%d, media %.2f ativos):\n", c, c_mean);
+  printf("  medido:  lambda=%.1f it/s  mu=%.1f it/s/consumidor  rho=%.3f  ocupado=%.1f%% do tempo ativo\n",
+         lambda, mu, rho, active_s > 0 ? 100.0 * busy_s / active_s : 0.0);
+  printf("           ca2=%.2f (chegadas)  cs2=%.2f (servico)  Lq=%.2f  Wq=%.3f ms\n",
+         ca2, cs2, lq, wq_s * 1e3);
+  printf("  Little:  lambda*Wq=%.2f  vs Lq amostrado=%.2f  desvio=%+.1f%%%s\n",
+         lambda * wq_s, lq, pct_dev(lq, lambda * wq_s),
+         G.cfg.drop == DROP_OLDEST ? " (Lq inclui itens depois expulsos)" : "");
+  if (mu <= 0 || rho >= 1.0){
+    printf("  M/M/c, M/D/c: sem regime estacionario (rho >= 1); a fila so e limitada pelo backpressure\n");
+    return;
+  }
+  double pw = erlang_c(c, lambda / mu);
+  double wq_mmc = pw / (c * mu - lambda);
+  double wq_mdc = wq_mmc / 2.0;                 // aproximação usual: M/D/c ~ metade da espera M/M/c
+  double wq_ggc = wq_mmc * (ca2 + cs2) / 2.0;   // Allen-Cunneen
+  printf("  M/M/c:   P(espera)=%.3f  Wq=%.3f ms  Lq=%.2f  desvio Wq=%+.1f%%\n",
+         pw, wq_mmc * 1e3, lambda * wq_mmc, pct_dev(wq_s, wq_mmc));
+  printf("  M/D/c:   Wq=%.3f ms  Lq=%.2f  desvio Wq=%+.1f%%\n",
+         wq_mdc * 1e3, lambda * wq_mdc, pct_dev(wq_s, wq_mdc));
+  printf("  G/G/c:   Wq=%.3f ms  Lq=%.2f  desvio Wq=%+.1f%% (Allen-Cunneen, ca2/cs2 medidos)\n",
+         wq_ggc * 1e3, lambda * wq_ggc, pct_dev(wq_s, wq_ggc));
+}
+
 // ---------- execução ----------
 int main(int argc, char **argv){
   parse_args(argc, argv, &G.cfg);
 
-  // série temporal
-  G.sample_ms = G.cfg.sample_ms;
-  G.max_samples = (G.cfg.duration_s*1000 / G.sample_ms) + 64;
-  G.samples = calloc(G.max_samples, sizeof(*G.samples));
+  // série temporal em memória (limitada; execuções longas devem usar --telemetry)
+  if (!G.cfg.telemetry_path){
+    long long want = (long long)G.cfg.duration_s * 1000000LL / G.cfg.sample_us + 64;
+    G.max_samples = want > 1000000 ? 1000000 : (int)want;
+    G.samples = calloc(G.max_samples, sizeof(*G.samples));
+  }
   G.samples_count = 0;
 
   // init
-  cbuf_init(&G.q, G.cfg.N, G.cfg.hwm, G.cfg.lwm);
+  cbuf_init(&G.q, &G.cfg);
   G.prod = calloc(G.cfg.P, sizeof(pthread_t));
-  G.cons = calloc(G.cfg.C, sizeof(pthread_t));
+  G.cons = calloc(G.cfg.cons_max, sizeof(cslot_t));
+  pthread_mutex_init(&G.pool_mtx, NULL);
+  for (int i=0;i<G.cfg.cons_max;i++) pthread_cond_init(&G.cons[i].cv, NULL);
   atomic_store_explicit(&G.stop, 0, memory_order_relaxed);
   atomic_store_explicit(&G.next_id, 0, memory_order_relaxed);
   memset(&G.m, 0, sizeof(G.m));
+  // burst do bucket = 1 rajada: não pune rajadas curtas quando a taxa é adequada
+  tb_init(&G.tb, G.cfg.bp == BP_HYST ? 0.0 : G.cfg.rate0, (double)G.cfg.burst_size);
+
+  if (G.cfg.trace_path && trace_open(&G, G.cfg.trace_path) != 0) return 1;
+  if (G.cfg.spill_path && spill_open(&G.q, G.cfg.spill_path, G.cfg.spill_bytes) != 0) return 1;
 
   // threads
-  for (long i=0;i<G.cfg.P;i++) pthread_create(&G.prod[i], NULL, producer, (void*)i);
-  for (long i=0;i<G.cfg.C;i++) pthread_create(&G.cons[i], NULL, consumer, NULL);
+  G.replay_t0 = now_ns() + 10000000LL; // 10 ms para todas as threads subirem
+  for (long i=0;i<G.cfg.P;i++)
+    pthread_create(&G.prod[i], NULL, G.trace ? trace_producer : producer, (void*)i);
+  pthread_mutex_lock(&G.pool_mtx);
+  for (int i=0;i<G.cfg.C;i++) pool_grow_locked(&G);
+  pthread_mutex_unlock(&G.pool_mtx);
+  int elastic = G.cfg.cons_min != G.cfg.cons_max;
+  if (elastic) pthread_create(&G.scaler, NULL, scaler, NULL);
   pthread_create(&G.sampler, NULL, sampler, NULL);
+  if (G.cfg.bp != BP_HYST) pthread_create(&G.controller, NULL, controller, NULL);
 
-  // duração
+  // duração (no replay termina antes se o trace acabar)
   long long t0 = now_ns();
-  sleep(G.cfg.duration_s);
+  long long deadline = t0 + (long long)G.cfg.duration_s * 1000000000LL;
+  while (now_ns() < deadline &&
+         !(G.trace && atomic_load(&G.producers_done) == G.cfg.P)){
+    sleep_ms(50);
+  }
   atomic_store_explicit(&G.stop, 1, memory_order_relaxed);
 
-  // injeta poison pills (uma por consumidor)
-  for (int i=0;i<G.cfg.C;i++){
-    item_t poison = {.id = -1, .enq_ns = now_ns()};
-    cbuf_push(&G.q, poison);
-  }
+  // scaler para de criar threads; estacionados acordam e encerram
+  if (elastic) pthread_join(G.scaler, NULL);
+  pthread_mutex_lock(&G.pool_mtx);
+  for (int i=0;i<G.cfg.cons_max;i++) pthread_cond_signal(&G.cons[i].cv);
+  pthread_mutex_unlock(&G.pool_mtx);
 
-  // join
+  // produtores primeiro: um item enfileirado depois da poison pill ficaria
+  // para trás (cada consumidor sai na primeira pílula que retira)
   for (int i=0;i<G.cfg.P;i++) pthread_join(G.prod[i], NULL);
-  for (int i=0;i<G.cfg.C;i++) pthread_join(G.cons[i], NULL);
+
+  // uma única poison pill: cada consumidor que a retira devolve ao buffer e sai,
+  // então ela circula por todos. Uma pílula por consumidor na última classe
+  // travaria aqui se o anel dela tivesse menos de C vagas (pílulas só saem
+  // quando o resto do buffer está vazio, e cada uma volta ao buffer).
+  item_t poison = {.id = POISON_ID, .intended_ns = now_ns(), .cls = G.cfg.classes - 1};
+  cbuf_push(&G.q, poison);
+
+  // join
+  for (int i=0;i<G.cfg.cons_max;i++) if (G.cons[i].created) pthread_join(G.cons[i].th, NULL);
   pthread_join(G.sampler, NULL);
+  if (G.cfg.bp != BP_HYST) pthread_join(G.controller, NULL);
 
   long long t1 = now_ns();
   double elapsed = (t1 - t0)/1e9;
@@ -312,6 +1598,9 @@ int main(int argc, char **argv){
   long long enq_wait = atomic_load_explicit(&G.m.enq_wait_ns, memory_order_relaxed);
   long long deq_wait = atomic_load_explicit(&G.m.deq_wait_ns, memory_order_relaxed);
   long long buf_lat  = atomic_load_explicit(&G.m.buf_lat_ns, memory_order_relaxed);
+  long long bp_wait  = atomic_load_explicit(&G.m.bp_wait_ns, memory_order_relaxed);
+  long offered = atomic_load_explicit(&G.m.offered, memory_order_relaxed);
+  long dropped = atomic_load_explicit(&G.m.dropped, memory_order_relaxed);
 
   double thr_prod = prod/elapsed;
   double thr_cons = cons/elapsed;
@@ -319,24 +1608,142 @@ int main(int argc, char **argv){
   double avg_deq_wait_ms = cons? (deq_wait/1e6)/ (double)cons : 0.0;
   double avg_buf_lat_ms  = cons? (buf_lat /1e6)/ (double)cons : 0.0;
 
+  // estabilidade: média/variância da ocupação (amostras periódicas => ponderadas no tempo)
+  double occ_mean = G.occ_mean;
+  double occ_var = G.occ_n ? G.occ_m2 / G.occ_n : 0.0;
+
   // resumo
+  static const char *bp_names[] = { "histerese", "aimd", "pid" };
+  static const char *drop_names[] = { "block", "drop-newest", "drop-oldest", "red", "sample-1-em-k" };
   printf("=== EX2 Estendido (bursts + backpressure + ocupacao) ===\n");
-  printf("P=%d C=%d N=%d  dur=%ds  burst=%d idle=%dms  HWM=%d LWM=%d  sample=%dms\n",
-         G.cfg.P, G.cfg.C, G.cfg.N, G.cfg.duration_s, G.cfg.burst_size,
-         G.cfg.idle_ms, G.cfg.hwm, G.cfg.lwm, G.cfg.sample_ms);
+  char dur[32], smp[32];
+  if (G.trace && !G.cfg.duration_set) snprintf(dur, sizeof dur, "trace");
+  else snprintf(dur, sizeof dur, "%ds", G.cfg.duration_s);
+  if (G.cfg.sample_us % 1000 == 0) snprintf(smp, sizeof smp, "%dms", G.cfg.sample_us / 1000);
+  else snprintf(smp, sizeof smp, "%dus", G.cfg.sample_us);
+  printf("P=%d C=%d N=%d  dur=%s  burst=%d idle=%dms  HWM=%d LWM=%d  sample=%s\n",
+         G.cfg.P, G.cfg.C, G.cfg.N, dur, G.cfg.burst_size,
+         G.cfg.idle_ms, G.cfg.hwm, G.cfg.lwm, smp);
+  if (G.cfg.drop != DROP_BLOCK){
+    printf("descarte: %s", drop_names[G.cfg.drop]);
+    if (G.cfg.drop == DROP_RED) printf(" maxp=%.2f", G.cfg.red_maxp);
+    if (G.cfg.drop == DROP_SAMPLE) printf(" k=%d", G.cfg.sample_k);
+    printf(" (produtores nunca bloqueiam)\n");
+  } else if (G.cfg.bp == BP_HYST){
+    printf("backpressure: histerese HWM/LWM\n");
+  } else if (G.cfg.target_lat_ms > 0){
+    printf("backpressure: token bucket + %s  alvo lat=%.2f ms  ctl=%dms\n",
+           bp_names[G.cfg.bp], G.cfg.target_lat_ms, G.cfg.ctl_ms);
+  } else {
+    printf("backpressure: token bucket + %s  alvo occ=%.1f  ctl=%dms\n",
+           bp_names[G.cfg.bp], G.cfg.target_occ, G.cfg.ctl_ms);
+  }
+  if (G.trace){
+    long arr = atomic_load(&G.replay_arrivals);
+    printf("replay: %s  speed=%.2fx  chegadas=%ld  atraso medio=%.3f ms  max=%.3f ms\n",
+           G.cfg.trace_path, G.cfg.speed, arr,
+           arr ? atomic_load(&G.replay_lag_ns) / 1e6 / (double)arr : 0.0,
+           atomic_load(&G.replay_max_lag_ns) / 1e6);
+    if (G.trace_invalid){
+      long line = 1;
+      for (size_t i=0;i<G.trace_bad_pos;i++) line += G.trace[i] == '\n';
+      printf("replay: %ld linha(s) invalida(s) ignorada(s) (primeira: %s:%ld)\n",
+             G.trace_invalid, G.cfg.trace_path, line);
+    }
+  }
   printf("produced=%ld consumed=%ld elapsed=%.2fs\n", prod, cons, elapsed);
+  double cons_ts = atomic_load(&G.cons_active_ns) / 1e9;
+  if (elastic) printf("pool elastico: min=%d max=%d janela=%dms  ", G.cfg.cons_min, G.cfg.cons_max,
+                      G.cfg.scale_window_ms);
+  else printf("pool fixo: C=%d  ", G.cfg.C);
+  printf("consumidor-thread-s=%.2f (media %.2f ativos)  lat/thread-s=%.3f ms  it/thread-s=%.1f\n",
+         cons_ts, elapsed > 0 ? cons_ts / elapsed : 0.0,
+         cons_ts > 0 ? avg_buf_lat_ms / cons_ts : 0.0, cons_ts > 0 ? cons / cons_ts : 0.0);
   printf("throughput: prod=%.2f it/s  cons=%.2f it/s\n", thr_prod, thr_cons);
+  long batches = atomic_load(&G.m.batches);
+  if (G.cfg.batch > 1 || G.cfg.cost_batch_us > 0 || G.cfg.cost_item_us != 2000){
+    printf("consumo: lote<=%d  custo=%.0f us/lote + %.0f us/item  lotes=%ld  itens/lote=%.2f\n",
+           G.cfg.batch, G.cfg.cost_batch_us, G.cfg.cost_item_us, batches,
+           batches ? cons / (double)batches : 0.0);
+  }
   printf("avg waits:  enq=%.3f ms  deq=%.3f ms  buf-lat=%.3f ms\n",
          avg_enq_wait_ms, avg_deq_wait_ms, avg_buf_lat_ms);
+  long long max_lat = atomic_load_explicit(&G.m.max_lat_ns, memory_order_relaxed);
+  printf("buf-lat:    p50=%.3f ms  p90=%.3f ms  p99=%.3f ms  max=%.3f ms\n",
+         hist_pct_ms(G.m.lat_hist, 0.50, max_lat), hist_pct_ms(G.m.lat_hist, 0.90, max_lat),
+         hist_pct_ms(G.m.lat_hist, 0.99, max_lat), max_lat / 1e6);
+  // mesma retirada medida desde a agenda: o atraso do produtor retido aparece aqui
+  long long int_max = atomic_load_explicit(&G.m.int_max_lat_ns, memory_order_relaxed);
+  printf("lat-agenda: p50=%.3f ms  p90=%.3f ms  p99=%.3f ms  max=%.3f ms  media=%.3f ms\n",
+         hist_pct_ms(G.m.int_hist, 0.50, int_max), hist_pct_ms(G.m.int_hist, 0.90, int_max),
+         hist_pct_ms(G.m.int_hist, 0.99, int_max), int_max / 1e6,
+         cons ? atomic_load(&G.m.int_lat_ns) / 1e6 / (double)cons : 0.0);
+  if (G.cfg.classes > 1){
+    printf("classes: K=%d  escalonador=%s\n", G.cfg.classes, G.cfg.sched == SCHED_DRR ? "drr" : "wrr");
+    for (int k=0;k<G.cfg.classes;k++){
+      long long mk = atomic_load(&G.m.cls_max_lat_ns[k]);
+      printf("  classe %d: peso=%g mix=%.2f cap=%d HWM=%d LWM=%d  offered=%ld consumed=%ld dropped=%ld"
+             "  p50=%.3f ms p99=%.3f ms max=%.3f ms\n",
+             k, G.cfg.cls_weight[k], G.cfg.cls_mix[k], G.cfg.cls_cap[k], G.cfg.cls_hwm[k],
+             G.cfg.cls_lwm[k], atomic_load(&G.m.cls_offered[k]), atomic_load(&G.m.cls_consumed[k]),
+             atomic_load(&G.m.cls_dropped[k]), hist_pct_ms(G.m.cls_hist[k], 0.50, mk),
+             hist_pct_ms(G.m.cls_hist[k], 0.99, mk), mk / 1e6);
+    }
+  }
+  if (G.q.spill){
+    // bytes escritos = lidos (o spill é drenado até o fim antes da poison pill)
+    double mib = G.q.spill_total * (double)sizeof(item_t) / 1048576.0;
+    // pílulas re-enfileiradas podem ter ficado no arquivo: fecha o intervalo ativo
+    if (G.q.spill_rd != G.q.spill_wr) G.q.spill_active_ns += t1 - G.q.spill_since;
+    double act = G.q.spill_active_ns / 1e9;
+    long long ms = atomic_load(&G.m.spill_max_lat_ns);
+    printf("spill: %s  itens=%ld (%.1f%% do produzido)  volume=%.2f MiB  backlog max=%ld itens\n",
+           G.cfg.spill_path, G.q.spill_total, prod ? 100.0 * G.q.spill_total / (double)prod : 0.0,
+           mib, G.q.spill_max);
+    printf("spill: ativo=%.2fs  disco=%.2f MiB/s na execucao, %.2f MiB/s com spill ativo\n",
+           act, elapsed > 0 ? mib / elapsed : 0.0, act > 0 ? mib / act : 0.0);
+    printf("spill: lat ponta a ponta p50=%.3f ms  p99=%.3f ms  max=%.3f ms (%ld itens)\n",
+           hist_pct_ms(G.m.spill_hist, 0.50, ms), hist_pct_ms(G.m.spill_hist, 0.99, ms), ms / 1e6,
+           atomic_load(&G.m.spill_consumed));
+  }
+  printf("descartes:  offered=%ld dropped=%ld taxa=%.2f%%",
+         offered, dropped, offered ? 100.0 * dropped / (double)offered : 0.0);
+  if (G.cfg.drop == DROP_OLDEST) printf(" (expulsos do buffer=%ld)", atomic_load(&G.m.evicted));
+  printf("\n");
+  printf("backpressure: retido=%.3f ms/item\n", prod ? (bp_wait/1e6)/(double)prod : 0.0);
+  printf("ocupacao: media=%.2f var=%.2f desvio=%.2f\n", occ_mean, occ_var, sqrt(occ_var));
+  if (G.cfg.bp != BP_HYST) printf("taxa final do token bucket: %.1f it/s\n", G.tb.rate);
+  print_queue_model(elapsed, prod - atomic_load(&G.m.evicted), cons, avg_buf_lat_ms / 1e3, occ_mean);
 
   // série temporal (CSV)
-  printf("\n#CSV: t_ms,occ\n");
-  for (int i=0;i<G.samples_count;i++){
-    printf("%d,%d\n", G.samples[i].t_ms, G.samples[i].occ);
+  if (G.cfg.telemetry_path){
+    printf("\nserie temporal: %lld amostras em %s%s%s\n", G.occ_n, G.cfg.telemetry_path,
+           G.cfg.rotate_bytes > 0 ? ".N" : "",
+           G.tlog_failed ? " (INCOMPLETA: erro de escrita, ver stderr)" : "");
+    if (G.cfg.rotate_bytes > 0 && G.cfg.rotate_keep > 0)
+      printf("  retencao: so os ultimos %d segmentos\n", G.cfg.rotate_keep);
+  } else {
+    // colunas extras só quando o modo correspondente está ativo
+    int with_rate = G.cfg.bp != BP_HYST;
+    printf("\n#CSV: t_ms,occ%s%s%s\n", with_rate ? ",rate" : "", elastic ? ",cons" : "",
+           G.q.spill ? ",spill" : "");
+    for (int i=0;i<G.samples_count;i++){
+      if (G.cfg.sample_us % 1000 == 0) printf("%lld,%d", G.samples[i].t_us / 1000, G.samples[i].occ);
+      else printf("%.3f,%d", G.samples[i].t_us / 1000.0, G.samples[i].occ);
+      if (with_rate) printf(",%.1f", G.samples[i].rate);
+      if (elastic) printf(",%d", G.samples[i].cons);
+      if (G.q.spill) printf(",%ld", G.samples[i].spill);
+      printf("\n");
+    }
   }
 
   // limpeza
   cbuf_destroy(&G.q);
+  if (G.cfg.spill_path) unlink(G.cfg.spill_path);
+  pthread_mutex_destroy(&G.tb.mtx);
+  if (G.trace) munmap((void*)G.trace, G.trace_len);
+  for (int i=0;i<G.cfg.cons_max;i++) pthread_cond_destroy(&G.cons[i].cv);
+  pthread_mutex_destroy(&G.pool_mtx);
   free(G.prod); free(G.cons);
   free(G.samples);
 
@@ -1,11 +1,24 @@
 // relay_race_fixed.c
-// Corrida de revezamento com valores fixos (sem argumentos de linha de comando)
+// Corrida de revezamento; duração, K e trabalho ajustáveis (-t, -k, -w), com
+// repetições, aquecimento e resumo em texto/CSV/JSON (--repeat, --warmup, --format).
+// Biblioteca de barreiras (pthread, condvar, sense, futex, tree, dissemination,
+// tournament) atrás de barrier_t, escolhidas em tempo de execução com -b.
+// Pernas com trabalho de CPU calibrado (-s) para medir o overhead da barreira.
+// Modo -T: milhares de equipes multiplexadas como tarefas num pool de nproc workers.
 
 #define _GNU_SOURCE
+#include <getopt.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <math.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -15,68 +28,678 @@ static inline long now_ns(void) {
   return (long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
-static void ms_sleep_rand(int min_ms, int max_ms, unsigned *seed) {
-  int span = max_ms - min_ms + 1;
-  int ms = min_ms + (span > 0 ? (rand_r(seed) % span) : 0);
-  struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L };
-  nanosleep(&ts, NULL);
+/* ---------- Trabalho de CPU calibrado ---------- */
+// nanosleep tem granularidade/slack de dezenas de µs: com pernas curtas o RPM
+// mede o timer, não a barreira. O laço abaixo é calibrado na partida (iterações
+// por ns) e roda sem syscalls, então a duração de cada perna é conhecida.
+static double spin_iters_per_ns = 1.0;
+
+static void spin_iters(long n) {
+  for (long i = 0; i < n; i++) __asm__ __volatile__("" ::: "memory");
+}
+
+// melhor de 5 medições de ~20 ms (a menos perturbada por preempção)
+static void spin_calibrate(void) {
+  long n = 1 << 16;
+  long t0 = now_ns();
+  while (spin_iters(n), now_ns() - t0 < 20000000L) { n *= 2; t0 = now_ns(); }
+  double best = 0.0;
+  for (int i = 0; i < 5; i++) {
+    t0 = now_ns();
+    spin_iters(n);
+    double rate = n / (double)(now_ns() - t0);
+    if (rate > best) best = rate;
+  }
+  spin_iters_per_ns = best;
+}
+
+typedef enum { LEG_SLEEP = 0, LEG_SPIN_UNIFORM, LEG_SPIN_EXP } leg_mode_t;
+
+typedef struct {
+  leg_mode_t mode;
+  int  min_ms, max_ms;   // LEG_SLEEP
+  long min_ns, max_ns;   // LEG_SPIN_UNIFORM
+  long mean_ns;          // LEG_SPIN_EXP (cortada em 20x a média)
+} leg_t;
+
+// sorteia a duração ideal de uma perna, em ns
+static long leg_draw(const leg_t *lg, unsigned *seed) {
+  long ns;
+  switch (lg->mode) {
+    case LEG_SPIN_UNIFORM:
+      ns = lg->min_ns + (lg->max_ns > lg->min_ns
+                         ? (long)((rand_r(seed) / ((double)RAND_MAX + 1.0)) * (lg->max_ns - lg->min_ns + 1))
+                         : 0);
+      break;
+    case LEG_SPIN_EXP: {
+      double u = rand_r(seed) / ((double)RAND_MAX + 1.0);
+      ns = (long)(-log(1.0 - u) * lg->mean_ns);
+      if (ns > 20 * lg->mean_ns) ns = 20 * lg->mean_ns;
+      break;
+    }
+    default: {
+      int span = lg->max_ms - lg->min_ms + 1;
+      ns = (lg->min_ms + (span > 0 ? (rand_r(seed) % span) : 0)) * 1000000L;
+      break;
+    }
+  }
+  return ns;
 }
 
-/* ---------- Barreira: pthread_barrier_t ---------- */
-typedef pthread_barrier_t barrier_t;
+// executa uma perna (nanosleep ou laço calibrado) e retorna sua duração ideal em ns
+static long leg_run(const leg_t *lg, unsigned *seed) {
+  long ns = leg_draw(lg, seed);
+  if (lg->mode == LEG_SLEEP) {
+    struct timespec ts = { .tv_sec = ns / 1000000000L, .tv_nsec = ns % 1000000000L };
+    nanosleep(&ts, NULL);
+  } else {
+    spin_iters((long)(ns * spin_iters_per_ns));
+  }
+  return ns;
+}
 
-static int barrier_init(barrier_t *b, unsigned count) {
-  return pthread_barrier_init(b, NULL, count);
+/* ---------- Espera ativa ---------- */
+// Gira com pause e, depois de SPIN_LIMIT voltas, cede a CPU: com K > núcleos a
+// thread que falta chegar precisa rodar para a barreira abrir.
+#define SPIN_LIMIT 1024
+#define CACHE_LINE 64
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
 }
-static int barrier_wait(barrier_t *b) {
-  return pthread_barrier_wait(b);
+static inline void spin_wait(unsigned *spins) {
+  if (++*spins < SPIN_LIMIT) cpu_relax();
+  else sched_yield();
 }
+
+// um inteiro atômico por linha de cache (evita falso compartilhamento entre flags)
+typedef struct {
+  _Alignas(CACHE_LINE) atomic_int v;
+} padded_int_t;
+
+/* ---------- Barreiras ---------- */
+// Todas seguem o contrato de pthread_barrier_wait: exatamente uma thread por
+// rodada recebe BARRIER_SERIAL (a última a chegar, ou o campeão/id 0 nas
+// barreiras sem contador central). As de espera ativa usam inversão de sentido
+// (sense reversal), então podem ser reutilizadas sem reinicialização.
+#define BARRIER_SERIAL 1
+
+typedef enum {
+  BAR_PTHREAD = 0, // pthread_barrier_t
+  BAR_CONDVAR,     // mutex + condvar (o -DUSE_CUSTOM_BARRIER original)
+  BAR_SENSE,       // contador central + sentido global, espera ativa
+  BAR_FUTEX,       // contador central + geração, dorme em futex
+  BAR_TREE,        // árvore de combinação (fan-in TREE_FANIN), sentido global
+  BAR_DISSEM,      // disseminação: ceil(log2 K) rodadas de sinais par a par
+  BAR_TOURN,       // torneio: perdedores sinalizam o vencedor, campeão acorda a árvore
+  BAR_NKINDS
+} barrier_kind_t;
+
+static const char *barrier_names[BAR_NKINDS] = {
+  "pthread", "condvar", "sense", "futex", "tree", "dissemination", "tournament"
+};
+
+#define TREE_FANIN 4
+
+typedef struct {
+  _Alignas(CACHE_LINE) atomic_int count;
+  int fanin;
+  int parent;  // -1 na raiz
+} tree_node_t;
+
+// estado privado de cada thread (só a dona lê/escreve)
+typedef struct {
+  _Alignas(CACHE_LINE) int sense;
+  int parity;  // disseminação: alterna os dois conjuntos de flags
+} bar_local_t;
+
+typedef struct {
+  barrier_kind_t kind;
+  int n;
+  int levels;  // ceil(log2 n): disseminação e torneio
+#ifndef USE_CUSTOM_BARRIER
+  pthread_barrier_t pb;
+#endif
+  pthread_mutex_t mtx;
+  pthread_cond_t cv;
+  int cv_count;
+  unsigned cv_gen;
+  _Alignas(CACHE_LINE) atomic_int count;  // sense/futex: quem ainda falta chegar
+  _Alignas(CACHE_LINE) atomic_int sense;  // sense/tree: sentido global; futex: geração
+  bar_local_t *local;
+  tree_node_t *nodes;
+  padded_int_t *flags;    // disseminação: [id][paridade][nível]; torneio: chegada [id][nível]
+  padded_int_t *release;  // torneio: liberação por thread
+} barrier_t;
+
+static long futex(atomic_int *addr, int op, int val) {
+  return syscall(SYS_futex, (int *)addr, op, val, NULL, NULL, 0);
+}
+
+// Monta a árvore nível a nível: folhas com até TREE_FANIN threads (a thread i
+// chega na folha i / TREE_FANIN), cada nível acima com até TREE_FANIN filhos.
+static int tree_build(barrier_t *b) {
+  int leaves = (b->n + TREE_FANIN - 1) / TREE_FANIN;
+  int total = 0;
+  for (int w = leaves; ; w = (w + TREE_FANIN - 1) / TREE_FANIN) {
+    total += w;
+    if (w == 1) break;
+  }
+  b->nodes = aligned_alloc(CACHE_LINE, sizeof(tree_node_t) * (size_t)total);
+  if (!b->nodes) return -1;
+  int start = 0, width = leaves, members = b->n;
+  for (;;) {
+    int next = start + width;
+    for (int j = 0; j < width; j++) {
+      tree_node_t *nd = &b->nodes[start + j];
+      nd->fanin = (j + 1) * TREE_FANIN <= members ? TREE_FANIN : members - j * TREE_FANIN;
+      atomic_init(&nd->count, nd->fanin);
+      nd->parent = width == 1 ? -1 : next + j / TREE_FANIN;
+    }
+    if (width == 1) break;
+    members = width;
+    start = next;
+    width = (width + TREE_FANIN - 1) / TREE_FANIN;
+  }
+  return 0;
+}
+
+static padded_int_t *padded_alloc(int n) {
+  padded_int_t *p = aligned_alloc(CACHE_LINE, sizeof(padded_int_t) * (size_t)n);
+  if (p) for (int i = 0; i < n; i++) atomic_init(&p[i].v, 0);
+  return p;
+}
+
+static int barrier_init(barrier_t *b, barrier_kind_t kind, unsigned count) {
+  memset(b, 0, sizeof(*b));
+  b->kind = kind;
+  b->n = (int)count;
+  while ((1 << b->levels) < b->n) b->levels++;
+  atomic_init(&b->count, b->n);
+  atomic_init(&b->sense, 0);
+  b->local = aligned_alloc(CACHE_LINE, sizeof(bar_local_t) * count);
+  if (!b->local) return -1;
+  for (unsigned i = 0; i < count; i++) { b->local[i].sense = 0; b->local[i].parity = 0; }
+
+  switch (kind) {
+    case BAR_PTHREAD:
+#ifdef USE_CUSTOM_BARRIER
+      return -1;
+#else
+      return pthread_barrier_init(&b->pb, NULL, count);
+#endif
+    case BAR_CONDVAR:
+      pthread_mutex_init(&b->mtx, NULL);
+      pthread_cond_init(&b->cv, NULL);
+      return 0;
+    case BAR_TREE:
+      return tree_build(b);
+    case BAR_DISSEM:
+      // sentido começa em 1 para diferir das flags zeradas
+      for (unsigned i = 0; i < count; i++) b->local[i].sense = 1;
+      b->flags = padded_alloc(b->n * 2 * (b->levels ? b->levels : 1));
+      return b->flags ? 0 : -1;
+    case BAR_TOURN:
+      for (unsigned i = 0; i < count; i++) b->local[i].sense = 1;
+      b->flags = padded_alloc(b->n * (b->levels ? b->levels : 1));
+      b->release = padded_alloc(b->n);
+      return b->flags && b->release ? 0 : -1;
+    default:
+      return 0;
+  }
+}
+
+static int barrier_wait_sense(barrier_t *b, int id) {
+  int s = b->local[id].sense = !b->local[id].sense;
+  if (atomic_fetch_sub_explicit(&b->count, 1, memory_order_acq_rel) == 1) {
+    atomic_store_explicit(&b->count, b->n, memory_order_relaxed);
+    atomic_store_explicit(&b->sense, s, memory_order_release);
+    return BARRIER_SERIAL;
+  }
+  unsigned spins = 0;
+  while (atomic_load_explicit(&b->sense, memory_order_acquire) != s) spin_wait(&spins);
+  return 0;
+}
+
+static int barrier_wait_futex(barrier_t *b) {
+  int gen = atomic_load_explicit(&b->sense, memory_order_acquire);
+  if (atomic_fetch_sub_explicit(&b->count, 1, memory_order_acq_rel) == 1) {
+    atomic_store_explicit(&b->count, b->n, memory_order_relaxed);
+    atomic_fetch_add_explicit(&b->sense, 1, memory_order_release);
+    futex(&b->sense, FUTEX_WAKE_PRIVATE, INT_MAX);
+    return BARRIER_SERIAL;
+  }
+  // gira um pouco antes de dormir: rodadas curtas não pagam a syscall
+  for (int i = 0; i < SPIN_LIMIT; i++) {
+    if (atomic_load_explicit(&b->sense, memory_order_acquire) != gen) return 0;
+    cpu_relax();
+  }
+  while (atomic_load_explicit(&b->sense, memory_order_acquire) == gen)
+    futex(&b->sense, FUTEX_WAIT_PRIVATE, gen);
+  return 0;
+}
+
+// O último a chegar num nó rearma o contador e sobe; quem fecha a raiz inverte
+// o sentido global, liberando todos.
+static int barrier_wait_tree(barrier_t *b, int id) {
+  int s = b->local[id].sense = !b->local[id].sense;
+  int node = id / TREE_FANIN;
+  for (;;) {
+    tree_node_t *nd = &b->nodes[node];
+    if (atomic_fetch_sub_explicit(&nd->count, 1, memory_order_acq_rel) != 1) break;
+    atomic_store_explicit(&nd->count, nd->fanin, memory_order_relaxed);
+    if (nd->parent < 0) {
+      atomic_store_explicit(&b->sense, s, memory_order_release);
+      return BARRIER_SERIAL;
+    }
+    node = nd->parent;
+  }
+  unsigned spins = 0;
+  while (atomic_load_explicit(&b->sense, memory_order_acquire) != s) spin_wait(&spins);
+  return 0;
+}
+
+// No nível k a thread i sinaliza (i + 2^k) mod n e espera o sinal de (i - 2^k).
+static int barrier_wait_dissem(barrier_t *b, int id) {
+  bar_local_t *me = &b->local[id];
+  int L = b->levels;
+  for (int k = 0; k < L; k++) {
+    int partner = (id + (1 << k)) % b->n;
+    atomic_store_explicit(&b->flags[(partner * 2 + me->parity) * L + k].v, me->sense,
+                          memory_order_release);
+    atomic_int *mine = &b->flags[(id * 2 + me->parity) * L + k].v;
+    unsigned spins = 0;
+    while (atomic_load_explicit(mine, memory_order_acquire) != me->sense) spin_wait(&spins);
+  }
+  if (me->parity) me->sense = !me->sense;
+  me->parity = !me->parity;
+  return id == 0 ? BARRIER_SERIAL : 0;
+}
+
+// Nível k: i com os k+1 bits baixos zerados vence (espera i + 2^k, se existir);
+// i com resto 2^k perde, avisa o vencedor e espera ser liberado. O campeão (0)
+// e cada perdedor liberado acordam os perdedores dos níveis abaixo do seu.
+static int barrier_wait_tourn(barrier_t *b, int id) {
+  int s = b->local[id].sense;
+  int L = b->levels;
+  int level = L;
+  for (int k = 0; k < L; k++) {
+    int step = 1 << k;
+    if ((id & ((step << 1) - 1)) == 0) {
+      if (id + step < b->n) {
+        atomic_int *arr = &b->flags[id * L + k].v;
+        unsigned spins = 0;
+        while (atomic_load_explicit(arr, memory_order_acquire) != s) spin_wait(&spins);
+      }
+    } else {
+      atomic_store_explicit(&b->flags[(id - step) * L + k].v, s, memory_order_release);
+      atomic_int *rel = &b->release[id].v;
+      unsigned spins = 0;
+      while (atomic_load_explicit(rel, memory_order_acquire) != s) spin_wait(&spins);
+      level = k;
+      break;
+    }
+  }
+  for (int k = level - 1; k >= 0; k--) {
+    if (id + (1 << k) < b->n)
+      atomic_store_explicit(&b->release[id + (1 << k)].v, s, memory_order_release);
+  }
+  b->local[id].sense = !s;
+  return id == 0 ? BARRIER_SERIAL : 0;
+}
+
+static int barrier_wait(barrier_t *b, int id) {
+  switch (b->kind) {
+#ifndef USE_CUSTOM_BARRIER
+    case BAR_PTHREAD:
+      return pthread_barrier_wait(&b->pb) == PTHREAD_BARRIER_SERIAL_THREAD ? BARRIER_SERIAL : 0;
+#endif
+    case BAR_CONDVAR: {
+      pthread_mutex_lock(&b->mtx);
+      unsigned gen = b->cv_gen;
+      if (++b->cv_count == b->n) {
+        b->cv_count = 0;
+        b->cv_gen++;
+        pthread_cond_broadcast(&b->cv);
+        pthread_mutex_unlock(&b->mtx);
+        return BARRIER_SERIAL;
+      }
+      while (gen == b->cv_gen) pthread_cond_wait(&b->cv, &b->mtx);
+      pthread_mutex_unlock(&b->mtx);
+      return 0;
+    }
+    case BAR_SENSE:  return barrier_wait_sense(b, id);
+    case BAR_FUTEX:  return barrier_wait_futex(b);
+    case BAR_TREE:   return barrier_wait_tree(b, id);
+    case BAR_DISSEM: return barrier_wait_dissem(b, id);
+    case BAR_TOURN:  return barrier_wait_tourn(b, id);
+    default:         return 0;
+  }
+}
+
 static int barrier_destroy(barrier_t *b) {
-  return pthread_barrier_destroy(b);
+#ifndef USE_CUSTOM_BARRIER
+  if (b->kind == BAR_PTHREAD) pthread_barrier_destroy(&b->pb);
+#endif
+  if (b->kind == BAR_CONDVAR) {
+    pthread_cond_destroy(&b->cv);
+    pthread_mutex_destroy(&b->mtx);
+  }
+  free(b->local);
+  free(b->nodes);
+  free(b->flags);
+  free(b->release);
+  return 0;
 }
 /* ------------------------------------------------- */
 
+// progresso por experimento; vai para stderr quando stdout leva CSV/JSON
+static FILE *log_out;
+
+/* ---------- Fixação de threads (-p) ---------- */
+// compact: corredores vizinhos em CPUs vizinhas (irmãs SMT, depois núcleos do
+// mesmo pacote); scatter: espalha primeiro por pacote e núcleo, irmãs SMT por
+// último. A topologia vem do sysfs; com K > CPUs a ordem dá a volta.
+typedef enum { PIN_NONE = 0, PIN_COMPACT, PIN_SCATTER } pin_mode_t;
+static const char *pin_names[] = { "livre", "compact", "scatter" };
+static pin_mode_t pin_mode = PIN_NONE;
+static int pin_cpus[CPU_SETSIZE];
+static int pin_ncpus = 0;   // 0 = sem fixação
+
+static int online_cpus(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+static int topo_read(int cpu, const char *what) {
+  char path[128];
+  snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, what);
+  FILE *f = fopen(path, "r");
+  int v = -1;
+  if (f) {
+    if (fscanf(f, "%d", &v) != 1) v = -1;
+    fclose(f);
+  }
+  return v;
+}
+
+typedef struct { int cpu, pkg, core, smt; } cpu_topo_t;
+
+static int cmp_compact(const void *a, const void *b) {
+  const cpu_topo_t *x = a, *y = b;
+  if (x->pkg != y->pkg) return x->pkg - y->pkg;
+  if (x->core != y->core) return x->core - y->core;
+  return x->smt - y->smt;
+}
+
+static int cmp_scatter(const void *a, const void *b) {
+  const cpu_topo_t *x = a, *y = b;
+  if (x->smt != y->smt) return x->smt - y->smt;
+  if (x->core != y->core) return x->core - y->core;
+  return x->pkg - y->pkg;
+}
+
+// ordena as CPUs permitidas ao processo conforme o modo; retorna quantas
+static int pin_setup(pin_mode_t mode) {
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof set, &set) != 0) return 0;
+  static cpu_topo_t topo[CPU_SETSIZE];
+  int n = 0;
+  for (int c = 0; c < CPU_SETSIZE; c++) {
+    if (!CPU_ISSET(c, &set)) continue;
+    topo[n].cpu = c;
+    topo[n].pkg = topo_read(c, "physical_package_id");
+    topo[n].core = topo_read(c, "core_id");
+    if (topo[n].core < 0) topo[n].core = c;
+    topo[n].smt = 0;  // posição entre as irmãs do mesmo núcleo
+    for (int j = 0; j < n; j++)
+      if (topo[j].pkg == topo[n].pkg && topo[j].core == topo[n].core) topo[n].smt++;
+    n++;
+  }
+  qsort(topo, (size_t)n, sizeof(cpu_topo_t), mode == PIN_COMPACT ? cmp_compact : cmp_scatter);
+  for (int i = 0; i < n; i++) pin_cpus[i] = topo[i].cpu;
+  pin_mode = mode;
+  pin_ncpus = n;
+  return n;
+}
+
+static void pin_self(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof set, &set) != 0) perror("sched_setaffinity");
+}
+
+// Carimbos das últimas rodadas de cada thread, num anel próprio. A thread 0 lê
+// os da rodada r depois de passar a barreira r+1, quando todas já os escreveram
+// e nenhuma pode ter chegado à rodada r+2; para isso bastam 4 entradas. Com -S o
+// anel guarda STAMP_RING rodadas, que alimentam a análise de stragglers.
+#define STAMP_RING     16384   // potências de 2
+#define STAMP_RING_MIN 4
+typedef struct {
+  long arrive, release;
+  long leg;                    // duração ideal da perna
+} stamp_t;
+
 typedef struct {
   int                id;
-  int                min_ms, max_ms;
+  int                K;
+  const leg_t       *leg;
   barrier_t         *barrier;
   atomic_long       *rounds;
   atomic_int        *running;
+  atomic_int        *go;       // go[2]: decisão de continuar publicada pela thread serial
+  atomic_int        *measuring; // 0 durante o aquecimento (--warmup)
+  int                measured;  // já viu measuring=1 (e leu ru0)
+  stamp_t           *stamps;   // K anéis de ring entradas, um após o outro
+  long               ring;
+  int                cpu;      // CPU fixada (-1 = livre)
+  long               last_round; // última rodada disputada (igual em todas)
+  long               wake_sum, wake_max; // thread 0: latência de liberação por rodada
+  long               wake_n;
+  long               ideal_sum; // thread 0: soma da maior perna de cada rodada
+  struct rusage      ru0, ru;   // getrusage(RUSAGE_THREAD) ao fim do aquecimento e ao sair
 } worker_args_t;
 
+// Encerramento: depois da barreira r a thread serial grava em go[(r+1)&1] se a
+// prova continua; na rodada r todas leem go[r&1], gravado antes da barreira r
+// pela serial da rodada anterior. Todas saem juntas, na mesma rodada, sem o
+// barrier_wait extra (que travava se uma thread visse running=0 uma rodada antes).
 static void *runner(void *arg) {
   worker_args_t *wa = (worker_args_t *)arg;
   unsigned seed = (unsigned)(time(NULL) ^ (wa->id * 2654435761u));
-  while (atomic_load_explicit(wa->running, memory_order_relaxed)) {
-    ms_sleep_rand(wa->min_ms, wa->max_ms, &seed);
-    int rc = barrier_wait(wa->barrier);
-    if (rc == PTHREAD_BARRIER_SERIAL_THREAD)
+  stamp_t *me = &wa->stamps[(size_t)wa->id * wa->ring];
+  if (wa->cpu >= 0) pin_self(wa->cpu);
+  long r;
+  for (r = 1; ; r++) {
+    if (!wa->measured && atomic_load_explicit(wa->measuring, memory_order_relaxed)) {
+      getrusage(RUSAGE_THREAD, &wa->ru0);
+      wa->measured = 1;
+    }
+    stamp_t *st = &me[r & (wa->ring - 1)];
+    st->leg = leg_run(wa->leg, &seed);
+    st->arrive = now_ns();
+    int rc = barrier_wait(wa->barrier, wa->id);
+    st->release = now_ns();
+    if (rc == BARRIER_SERIAL) {
       atomic_fetch_add_explicit(wa->rounds, 1, memory_order_relaxed);
+      atomic_store_explicit(&wa->go[(r + 1) & 1],
+                            atomic_load_explicit(wa->running, memory_order_relaxed),
+                            memory_order_relaxed);
+    }
+    // latência de liberação da rodada anterior: última liberação - última chegada;
+    // trabalho ideal da rodada = maior perna (a rodada não termina antes dela)
+    if (wa->id == 0 && r > 1 && wa->measured) {
+      long slot = (r - 1) & (wa->ring - 1);
+      long last_arr = 0, last_rel = 0, max_leg = 0;
+      for (int i = 0; i < wa->K; i++) {
+        const stamp_t *st = &wa->stamps[(size_t)i * wa->ring + slot];
+        if (st->arrive > last_arr) last_arr = st->arrive;
+        if (st->release > last_rel) last_rel = st->release;
+        if (st->leg > max_leg) max_leg = st->leg;
+      }
+      wa->ideal_sum += max_leg;
+      long wake = last_rel - last_arr;
+      wa->wake_sum += wake;
+      if (wake > wa->wake_max) wa->wake_max = wake;
+      wa->wake_n++;
+    }
+    if (!atomic_load_explicit(&wa->go[r & 1], memory_order_relaxed)) break;
   }
-  barrier_wait(wa->barrier);
+  wa->last_round = r;
+  getrusage(RUSAGE_THREAD, &wa->ru);
   return NULL;
 }
 
-static double run_experiment(int K, double seconds, int min_ms, int max_ms) {
+static int cmp_long(const void *a, const void *b) {
+  long x = *(const long *)a, y = *(const long *)b;
+  return (x > y) - (x < y);
+}
+
+// percentil q de v[0..n) já ordenado
+static long pct(const long *v, long n, double q) {
+  long i = (long)(q * (double)(n - 1) + 0.5);
+  return v[i < n ? i : n - 1];
+}
+
+// histograma log2 em µs: balde 0 = <1 µs, balde b = [2^(b-1), 2^b) µs
+#define WAIT_BUCKETS 18
+static int wait_bucket(long ns) {
+  long us = ns / 1000;
+  int b = 0;
+  while (us > 0 && b < WAIT_BUCKETS - 1) { us >>= 1; b++; }
+  return b;
+}
+
+// Análise de stragglers sobre as rodadas ainda no anel: desalinhamento das
+// chegadas (última − primeira), quem chegou por último e quanto cada thread
+// esperou na barreira (saída − chegada). Se o desalinhamento domina a latência
+// de liberação, a perda de RPM vem das pernas; se um membro é o último bem mais
+// que 1/K das vezes, vem dele.
+static void straggler_report(int K, const stamp_t *stamps, long ring, long last_round) {
+  long first = last_round - ring + 1 > 1 ? last_round - ring + 1 : 1;
+  long n = last_round - first + 1;
+  if (n <= 0) return;
+  long *skew = malloc(sizeof(long) * (size_t)n);
+  long *wait = malloc(sizeof(long) * (size_t)n * (size_t)K);
+  long *last_cnt = calloc((size_t)K, sizeof(long));
+  long (*hist)[WAIT_BUCKETS] = calloc((size_t)K, sizeof *hist);
+  if (!skew || !wait || !last_cnt || !hist) {
+    free(skew); free(wait); free(last_cnt); free(hist);
+    return;
+  }
+  double skew_sum = 0.0, wake_sum = 0.0;
+  for (long j = 0; j < n; j++) {
+    long slot = (first + j) & (ring - 1);
+    long min_arr = LONG_MAX, max_arr = 0, max_rel = 0;
+    int who = 0;
+    for (int i = 0; i < K; i++) {
+      const stamp_t *st = &stamps[(size_t)i * ring + slot];
+      if (st->arrive < min_arr) min_arr = st->arrive;
+      if (st->arrive > max_arr) { max_arr = st->arrive; who = i; }
+      if (st->release > max_rel) max_rel = st->release;
+      long w = st->release - st->arrive;
+      wait[(size_t)i * n + j] = w;
+      hist[i][wait_bucket(w)]++;
+    }
+    skew[j] = max_arr - min_arr;
+    last_cnt[who]++;
+    skew_sum += skew[j];
+    wake_sum += max_rel - max_arr;
+  }
+  qsort(skew, (size_t)n, sizeof(long), cmp_long);
+  double skew_avg = skew_sum / 1e3 / (double)n, wake_avg = wake_sum / 1e3 / (double)n;
+  fprintf(log_out, "    stragglers (últimas %ld rodadas): desalinhamento p50=%.1f p90=%.1f p99=%.1f máx=%.1f µs"
+         "  média=%.1f µs vs liberação média=%.1f µs\n",
+         n, pct(skew, n, 0.50) / 1e3, pct(skew, n, 0.90) / 1e3, pct(skew, n, 0.99) / 1e3,
+         skew[n - 1] / 1e3, skew_avg, wake_avg);
+
+  // só as colunas do histograma com alguma contagem
+  int bmin = WAIT_BUCKETS, bmax = -1;
+  for (int i = 0; i < K; i++)
+    for (int b = 0; b < WAIT_BUCKETS; b++)
+      if (hist[i][b]) { if (b < bmin) bmin = b; if (b > bmax) bmax = b; }
+  fprintf(log_out, "    %-4s %7s %9s %9s %9s %9s  espera por balde (µs ≥)", "thr", "último", "p50 µs",
+         "p90 µs", "p99 µs", "máx µs");
+  fprintf(log_out, "\n    %-4s %7s %9s %9s %9s %9s ", "", "", "", "", "", "");
+  for (int b = bmin; b <= bmax; b++) fprintf(log_out, " %6ld", b ? 1L << (b - 1) : 0L);
+  fprintf(log_out, "\n");
+  int top = 0;
+  for (int i = 0; i < K; i++) {
+    long *w = &wait[(size_t)i * n];
+    qsort(w, (size_t)n, sizeof(long), cmp_long);
+    if (last_cnt[i] > last_cnt[top]) top = i;
+    fprintf(log_out, "    t%-3d %6.1f%% %9.1f %9.1f %9.1f %9.1f ", i, 100.0 * last_cnt[i] / (double)n,
+           pct(w, n, 0.50) / 1e3, pct(w, n, 0.90) / 1e3, pct(w, n, 0.99) / 1e3, w[n - 1] / 1e3);
+    for (int b = bmin; b <= bmax; b++) fprintf(log_out, " %6ld", hist[i][b]);
+    fprintf(log_out, "\n");
+  }
+  double top_share = (double)last_cnt[top] / (double)n;
+  if (skew_avg <= wake_avg)
+    fprintf(log_out, "    → perda dominada pela mecânica da barreira (liberação ≥ desalinhamento)\n");
+  else if (K > 1 && top_share > 2.0 / K)
+    fprintf(log_out, "    → perda dominada por um membro lento: t%d chegou por último em %.1f%% das rodadas"
+           " (uniforme seria %.1f%%)\n", top, 100.0 * top_share, 100.0 / K);
+  else
+    fprintf(log_out, "    → perda dominada pela variação das pernas, distribuída entre os membros\n");
+  free(skew); free(wait); free(last_cnt); free(hist);
+}
+
+typedef struct {
+  double rounds_s, rpm;
+  double wake_avg_us, wake_max_us;
+  double round_us, ideal_us, overhead_us; // por rodada: medido, trabalho ideal e a diferença
+  double nvcsw, nivcsw, cpu_us;           // por rodada, somando as K threads
+} result_t;
+
+static result_t run_experiment(int K, barrier_kind_t kind, double seconds, double warmup,
+                               const leg_t *leg, int stragglers) {
+  result_t res = {0};
   pthread_t *th = calloc(K, sizeof(pthread_t));
   worker_args_t *args = calloc(K, sizeof(worker_args_t));
+  long ring = stragglers ? STAMP_RING : STAMP_RING_MIN;
+  stamp_t *stamps = aligned_alloc(CACHE_LINE, sizeof(stamp_t) * ring * (size_t)K);
   barrier_t barrier;
   atomic_long rounds = 0;
   atomic_int running = 1;
+  atomic_int go[2] = {1, 1};
+  atomic_int measuring = warmup <= 0.0;
 
-  barrier_init(&barrier, (unsigned)K);
+  if (!th || !args || !stamps || barrier_init(&barrier, kind, (unsigned)K) != 0) {
+    fprintf(stderr, "barreira %s indisponível para K=%d\n", barrier_names[kind], K);
+    free(th); free(args); free(stamps);
+    return res;
+  }
+  memset(stamps, 0, sizeof(stamp_t) * ring * (size_t)K);
 
   for (int i = 0; i < K; i++) {
     args[i].id = i;
-    args[i].min_ms = min_ms;
-    args[i].max_ms = max_ms;
+    args[i].K = K;
+    args[i].leg = leg;
     args[i].barrier = &barrier;
     args[i].rounds = &rounds;
     args[i].running = &running;
+    args[i].go = go;
+    args[i].measuring = &measuring;
+    args[i].stamps = stamps;
+    args[i].ring = ring;
+    args[i].cpu = pin_ncpus ? pin_cpus[i % pin_ncpus] : -1;
     pthread_create(&th[i], NULL, runner, &args[i]);
   }
 
+  // aquecimento: rodadas, carimbos da thread 0 e rusage só contam depois dele
+  if (warmup > 0.0) {
+    struct timespec ts = { .tv_sec = (time_t)warmup,
+                           .tv_nsec = (long)((warmup - (long)warmup) * 1e9) };
+    nanosleep(&ts, NULL);
+  }
+  long r0 = atomic_load(&rounds);
   long t0 = now_ns();
+  atomic_store(&measuring, 1);
   long deadline = t0 + (long)(seconds * 1e9);
   while (now_ns() < deadline) {
     struct timespec ts = { .tv_sec = 0, .tv_nsec = 50 * 1000000L };
@@ -87,32 +710,531 @@ static double run_experiment(int K, double seconds, int min_ms, int max_ms) {
 
   for (int i = 0; i < K; i++) pthread_join(th[i], NULL);
 
-  long total_rounds = atomic_load(&rounds);
+  long total_rounds = atomic_load(&rounds) - r0;
   long t1 = now_ns();
   double elapsed_s = (double)(t1 - t0) / 1e9;
 
   barrier_destroy(&barrier);
+
+  res.rounds_s = elapsed_s > 0.0 ? total_rounds / elapsed_s : 0.0;
+  res.rpm = res.rounds_s * 60.0;
+  res.wake_avg_us = args[0].wake_n ? args[0].wake_sum / 1e3 / (double)args[0].wake_n : 0.0;
+  res.wake_max_us = args[0].wake_max / 1e3;
+  res.round_us = total_rounds ? elapsed_s * 1e6 / (double)total_rounds : 0.0;
+  res.ideal_us = args[0].wake_n ? args[0].ideal_sum / 1e3 / (double)args[0].wake_n : 0.0;
+  res.overhead_us = res.round_us - res.ideal_us;
+  double nvcsw = 0.0, nivcsw = 0.0, cpu_s = 0.0;
+  for (int i = 0; i < K; i++) {
+    const struct rusage *a = &args[i].ru0, *b = &args[i].ru;
+    nvcsw += b->ru_nvcsw - a->ru_nvcsw;
+    nivcsw += b->ru_nivcsw - a->ru_nivcsw;
+    cpu_s += (b->ru_utime.tv_sec - a->ru_utime.tv_sec) + (b->ru_utime.tv_usec - a->ru_utime.tv_usec) / 1e6 +
+             (b->ru_stime.tv_sec - a->ru_stime.tv_sec) + (b->ru_stime.tv_usec - a->ru_stime.tv_usec) / 1e6;
+  }
+  if (total_rounds) {
+    res.nvcsw = nvcsw / (double)total_rounds;
+    res.nivcsw = nivcsw / (double)total_rounds;
+    res.cpu_us = cpu_s * 1e6 / (double)total_rounds;
+  }
+  fprintf(log_out, "Equipe K=%d [%s] → rodadas=%ld em %.2fs → RPM=%.2f (%.1f rodadas/s)"
+         "  liberação: média=%.1f µs máx=%.1f µs\n",
+         K, barrier_names[kind], total_rounds, elapsed_s, res.rpm, res.rounds_s,
+         res.wake_avg_us, res.wake_max_us);
+  fprintf(log_out, "    rodada=%.1f µs  trabalho ideal=%.1f µs  overhead=%.1f µs/rodada\n",
+         res.round_us, res.ideal_us, res.overhead_us);
+  fprintf(log_out, "    escalonamento [%s]: trocas de contexto/rodada voluntárias=%.2f involuntárias=%.2f"
+         "  CPU=%.1f µs/rodada (%.0f%% de %d CPUs)\n", pin_names[pin_mode], res.nvcsw, res.nivcsw,
+         res.cpu_us, elapsed_s > 0.0 ? 100.0 * cpu_s / elapsed_s / online_cpus() : 0.0,
+         online_cpus());
+  if (stragglers) straggler_report(K, stamps, ring, args[0].last_round);
   free(th);
   free(args);
+  free(stamps);
+  return res;
+}
+
+/* ---------- Equipes multiplexadas num pool (-T) ---------- */
+// T equipes de K corredores rodam ao mesmo tempo num pool de nproc workers. Um
+// corredor não tem thread própria: é uma tarefa "perna" na fila. A barreira de
+// cada equipe é um contador; quem chega por último zera o contador, conta a
+// rodada e recoloca na fila as K pernas da rodada seguinte. Ninguém bloqueia
+// esperando a equipe, então T*K pode passar de centenas de milhares.
+// Pernas de sono não ocupam worker: viram prazos num heap de uma thread
+// temporizadora, que enfileira a chegada quando o prazo vence.
+
+// tarefa = (equipe << 1) | tipo
+#define TASK_LEG    0u
+#define TASK_ARRIVE 1u
 
-  double rpm = (elapsed_s > 0.0) ? (total_rounds * 60.0 / elapsed_s) : 0.0;
-  printf("Equipe K=%d → rodadas=%ld em %.2fs → RPM=%.2f\n", K, total_rounds, elapsed_s, rpm);
-  return rpm;
+typedef struct {
+  _Alignas(CACHE_LINE) atomic_int arrived;
+  long rounds;   // só o último a chegar escreve (o contador serializa as rodadas)
+} team_t;
+
+// fila global de tarefas (mutex + condvar); cada corredor tem no máximo uma
+// tarefa pendente, então capacidade T*K nunca transborda
+typedef struct {
+  pthread_mutex_t m;
+  pthread_cond_t  cv;
+  unsigned       *buf;
+  size_t          mask, head, tail;
+  int             stop;
+} taskq_t;
+
+typedef struct { long at; unsigned task; } timer_ent_t;
+
+typedef struct {
+  pthread_mutex_t m;
+  pthread_cond_t  cv;     // relógio CLOCK_MONOTONIC
+  timer_ent_t    *heap;   // min-heap por prazo
+  size_t          n;
+  int             stop;
+} timerq_t;
+
+typedef struct {
+  int          K;
+  const leg_t *leg;
+  team_t      *teams;
+  taskq_t      q;
+  timerq_t     tq;
+  atomic_int   running;
+} pool_t;
+
+typedef struct {
+  pool_t   *pool;
+  int       id;
+  long      rounds, legs;
+} pool_worker_t;
+
+#define POOL_BATCH 64
+
+static void taskq_push(taskq_t *q, const unsigned *t, size_t n) {
+  pthread_mutex_lock(&q->m);
+  for (size_t i = 0; i < n; i++) q->buf[q->tail++ & q->mask] = t[i];
+  if (n > 1) pthread_cond_broadcast(&q->cv);
+  else pthread_cond_signal(&q->cv);
+  pthread_mutex_unlock(&q->m);
 }
 
-int main(void) {
-  // -------- Valores fixos --------
-  double seconds = 10.0;      // duração em segundos
-  int Ks[] = {2, 4, 8};       // tamanhos de equipe
+// n cópias da mesma tarefa (as K pernas de uma rodada), sem vetor temporário:
+// K vem de -k e não cabe com segurança na pilha
+static void taskq_push_rep(taskq_t *q, unsigned t, size_t n) {
+  pthread_mutex_lock(&q->m);
+  for (size_t i = 0; i < n; i++) q->buf[q->tail++ & q->mask] = t;
+  if (n > 1) pthread_cond_broadcast(&q->cv);
+  else pthread_cond_signal(&q->cv);
+  pthread_mutex_unlock(&q->m);
+}
+
+// retira até max tarefas; 0 quando a prova terminou
+static size_t taskq_pop(taskq_t *q, unsigned *out, size_t max) {
+  pthread_mutex_lock(&q->m);
+  while (q->head == q->tail && !q->stop) pthread_cond_wait(&q->cv, &q->m);
+  size_t n = 0;
+  if (!q->stop)
+    while (n < max && q->head != q->tail) out[n++] = q->buf[q->head++ & q->mask];
+  pthread_mutex_unlock(&q->m);
+  return n;
+}
+
+static void timer_add(timerq_t *tq, long at, unsigned task) {
+  pthread_mutex_lock(&tq->m);
+  size_t i = tq->n++;
+  while (i > 0 && tq->heap[(i - 1) / 2].at > at) {
+    tq->heap[i] = tq->heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  tq->heap[i] = (timer_ent_t){ at, task };
+  if (i == 0) pthread_cond_signal(&tq->cv);   // novo prazo mais cedo
+  pthread_mutex_unlock(&tq->m);
+}
+
+static timer_ent_t timer_pop_min(timerq_t *tq) {
+  timer_ent_t top = tq->heap[0], last = tq->heap[--tq->n];
+  size_t i = 0;
+  for (;;) {
+    size_t c = 2 * i + 1;
+    if (c >= tq->n) break;
+    if (c + 1 < tq->n && tq->heap[c + 1].at < tq->heap[c].at) c++;
+    if (last.at <= tq->heap[c].at) break;
+    tq->heap[i] = tq->heap[c];
+    i = c;
+  }
+  if (tq->n) tq->heap[i] = last;
+  return top;
+}
+
+static void *pool_timer(void *arg) {
+  pool_t *p = (pool_t *)arg;
+  timerq_t *tq = &p->tq;
+  unsigned due[POOL_BATCH];
+  pthread_mutex_lock(&tq->m);
+  while (!tq->stop) {
+    if (tq->n == 0) { pthread_cond_wait(&tq->cv, &tq->m); continue; }
+    long now = now_ns();
+    if (tq->heap[0].at > now) {
+      struct timespec ts = { .tv_sec = tq->heap[0].at / 1000000000L,
+                             .tv_nsec = tq->heap[0].at % 1000000000L };
+      pthread_cond_timedwait(&tq->cv, &tq->m, &ts);
+      continue;
+    }
+    size_t n = 0;
+    while (n < POOL_BATCH && tq->n && tq->heap[0].at <= now) due[n++] = timer_pop_min(tq).task;
+    pthread_mutex_unlock(&tq->m);
+    taskq_push(&p->q, due, n);
+    pthread_mutex_lock(&tq->m);
+  }
+  pthread_mutex_unlock(&tq->m);
+  return NULL;
+}
+
+// barreira da equipe: o último a chegar abre a rodada seguinte
+static void team_arrive(pool_t *p, pool_worker_t *w, unsigned team) {
+  team_t *tm = &p->teams[team];
+  if (atomic_fetch_add_explicit(&tm->arrived, 1, memory_order_acq_rel) != p->K - 1) return;
+  atomic_store_explicit(&tm->arrived, 0, memory_order_relaxed);
+  if (!atomic_load_explicit(&p->running, memory_order_relaxed)) return;
+  tm->rounds++;
+  w->rounds++;
+  taskq_push_rep(&p->q, team << 1 | TASK_LEG, (size_t)p->K);
+}
+
+static void *pool_worker(void *arg) {
+  pool_worker_t *w = (pool_worker_t *)arg;
+  pool_t *p = w->pool;
+  unsigned seed = (unsigned)(time(NULL) ^ (w->id * 2654435761u));
+  unsigned batch[POOL_BATCH];
+  size_t n;
+  while ((n = taskq_pop(&p->q, batch, POOL_BATCH)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      unsigned team = batch[i] >> 1;
+      if ((batch[i] & 1u) == TASK_LEG) {
+        w->legs++;
+        if (p->leg->mode == LEG_SLEEP) {
+          timer_add(&p->tq, now_ns() + leg_draw(p->leg, &seed), team << 1 | TASK_ARRIVE);
+          continue;
+        }
+        leg_run(p->leg, &seed);
+      }
+      team_arrive(p, w, team);
+    }
+  }
+  return NULL;
+}
+
+static void pool_experiment(int T, int K, double seconds, const leg_t *leg) {
+  int nw = online_cpus();
+  size_t ntasks = (size_t)T * (size_t)K, cap = 1;
+  while (cap < ntasks) cap <<= 1;
+
+  pool_t p = { .K = K, .leg = leg };
+  p.teams = aligned_alloc(CACHE_LINE, sizeof(team_t) * (size_t)T);
+  p.q.buf = malloc(sizeof(unsigned) * cap);
+  p.tq.heap = malloc(sizeof(timer_ent_t) * ntasks);
+  pool_worker_t *ws = calloc((size_t)nw, sizeof(pool_worker_t));
+  pthread_t *th = calloc((size_t)nw, sizeof(pthread_t));
+  if (!p.teams || !p.q.buf || !p.tq.heap || !ws || !th) {
+    fprintf(stderr, "sem memória para T=%d equipes de K=%d\n", T, K);
+    free(p.teams); free(p.q.buf); free(p.tq.heap); free(ws); free(th);
+    return;
+  }
+  memset(p.teams, 0, sizeof(team_t) * (size_t)T);
+  p.q.mask = cap - 1;
+  pthread_mutex_init(&p.q.m, NULL);
+  pthread_cond_init(&p.q.cv, NULL);
+  pthread_condattr_t ca;
+  pthread_condattr_init(&ca);
+  pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+  pthread_mutex_init(&p.tq.m, NULL);
+  pthread_cond_init(&p.tq.cv, &ca);
+  pthread_condattr_destroy(&ca);
+  atomic_init(&p.running, 1);
+
+  // largada: as K pernas de cada equipe
+  for (int t = 0; t < T; t++)
+    for (int i = 0; i < K; i++) p.q.buf[p.q.tail++] = (unsigned)t << 1 | TASK_LEG;
+
+  pthread_t timer;
+  long t0 = now_ns();
+  pthread_create(&timer, NULL, pool_timer, &p);
+  for (int i = 0; i < nw; i++) {
+    ws[i].pool = &p;
+    ws[i].id = i;
+    pthread_create(&th[i], NULL, pool_worker, &ws[i]);
+  }
+
+  struct timespec ts = { .tv_sec = (time_t)seconds,
+                         .tv_nsec = (long)((seconds - (long)seconds) * 1e9) };
+  nanosleep(&ts, NULL);
+  atomic_store(&p.running, 0);
+  long t1 = now_ns();
+
+  pthread_mutex_lock(&p.q.m);
+  p.q.stop = 1;
+  pthread_cond_broadcast(&p.q.cv);
+  pthread_mutex_unlock(&p.q.m);
+  pthread_mutex_lock(&p.tq.m);
+  p.tq.stop = 1;
+  pthread_cond_signal(&p.tq.cv);
+  pthread_mutex_unlock(&p.tq.m);
+  for (int i = 0; i < nw; i++) pthread_join(th[i], NULL);
+  pthread_join(timer, NULL);
+
+  long rounds = 0, legs = 0, rmin = LONG_MAX, rmax = 0;
+  for (int i = 0; i < nw; i++) { rounds += ws[i].rounds; legs += ws[i].legs; }
+  for (int t = 0; t < T; t++) {
+    if (p.teams[t].rounds < rmin) rmin = p.teams[t].rounds;
+    if (p.teams[t].rounds > rmax) rmax = p.teams[t].rounds;
+  }
+  double elapsed_s = (double)(t1 - t0) / 1e9;
+  double rounds_s = rounds / elapsed_s;
+  fprintf(log_out, "Pool T=%d × K=%d (%zu corredores, %d workers) → rodadas=%ld em %.2fs → %.1f rodadas/s"
+         " (RPM agregado=%.0f)\n", T, K, ntasks, nw, rounds, elapsed_s, rounds_s, rounds_s * 60.0);
+  fprintf(log_out, "    por equipe: %.2f rodadas/s (mín=%ld máx=%ld rodadas)  pernas/s=%.0f\n",
+         rounds_s / T, rmin, rmax, legs / elapsed_s);
+
+  pthread_mutex_destroy(&p.q.m);
+  pthread_cond_destroy(&p.q.cv);
+  pthread_mutex_destroy(&p.tq.m);
+  pthread_cond_destroy(&p.tq.cv);
+  free(p.teams); free(p.q.buf); free(p.tq.heap); free(ws); free(th);
+}
+
+// "-b all" ou lista separada por vírgula; retorna quantos tipos leu (0 se inválida)
+static int parse_barriers(const char *s, barrier_kind_t *out) {
+  if (!strcmp(s, "all")) {
+    int n = 0;
+    for (int k = 0; k < BAR_NKINDS; k++) {
+#ifdef USE_CUSTOM_BARRIER
+      if (k == BAR_PTHREAD) continue;
+#endif
+      out[n++] = (barrier_kind_t)k;
+    }
+    return n;
+  }
+  int n = 0;
+  char buf[256];
+  snprintf(buf, sizeof buf, "%s", s);
+  for (char *save = NULL, *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    int k = 0;
+    while (k < BAR_NKINDS && strcmp(tok, barrier_names[k])) k++;
+    if (k == BAR_NKINDS || n == BAR_NKINDS) return 0;
+    out[n++] = (barrier_kind_t)k;
+  }
+  return n;
+}
+
+// lista de inteiros positivos separados por vírgula; retorna quantos leu (0 se inválida)
+static int parse_ints(const char *s, int *out, int max) {
+  int n = 0;
+  char *end;
+  for (;;) {
+    long v = strtol(s, &end, 10);
+    if (end == s || v <= 0 || v > INT_MAX / 2 || n == max) return 0;
+    out[n++] = (int)v;
+    if (*end == '\0') return n;
+    if (*end != ',') return 0;
+    s = end + 1;
+  }
+}
+
+/* ---------- Repetições e intervalo de confiança ---------- */
+// RPM de cada repetição entra num acumulador de Welford; as demais métricas
+// são somadas e saem como média. IC 95% pela t de Student com R-1 graus.
+typedef struct {
+  int      n;
+  double   rpm_mean, rpm_m2;
+  result_t sum;
+} trials_t;
+
+static void trials_add(trials_t *t, const result_t *r) {
+  t->n++;
+  double d = r->rpm - t->rpm_mean;
+  t->rpm_mean += d / t->n;
+  t->rpm_m2 += d * (r->rpm - t->rpm_mean);
+  t->sum.rounds_s += r->rounds_s;
+  t->sum.wake_avg_us += r->wake_avg_us;
+  if (r->wake_max_us > t->sum.wake_max_us) t->sum.wake_max_us = r->wake_max_us;
+  t->sum.overhead_us += r->overhead_us;
+  t->sum.nvcsw += r->nvcsw;
+  t->sum.nivcsw += r->nivcsw;
+  t->sum.cpu_us += r->cpu_us;
+}
+
+// quantil 0,975 da t de Student com df graus de liberdade
+static double t975(int df) {
+  static const double t[] = { 0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+                              2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+                              2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+                              2.048, 2.045, 2.042 };
+  if (df < 1) return 0.0;
+  return df <= 30 ? t[df] : 1.960 + 2.4 / df;
+}
+
+static double trials_sd(const trials_t *t) {
+  return t->n > 1 ? sqrt(t->rpm_m2 / (t->n - 1)) : 0.0;
+}
+
+static double trials_ci(const trials_t *t) {
+  return t->n > 1 ? t975(t->n - 1) * trials_sd(t) / sqrt((double)t->n) : 0.0;
+}
+
+typedef enum { OUT_TEXT = 0, OUT_CSV, OUT_JSON } out_format_t;
+
+int main(int argc, char **argv) {
+  // -------- Valores padrão --------
+  double seconds = 10.0;      // duração em segundos (-t)
+  int Ks[16] = {2, 4, 8};     // tamanhos de equipe (-k)
   int nK = 3;
-  int min_ms = 5, max_ms = 15; // trabalho simulado (ms)
+  int min_ms = 5, max_ms = 15; // trabalho simulado em ms (-w)
+  int repeat = 1;             // --repeat: repetições por K e barreira
+  double warmup = 0.0;        // --warmup: segundos descartados antes de medir
+  out_format_t format = OUT_TEXT;
   // -------------------------------
+  leg_t leg = { .mode = LEG_SLEEP };
+  log_out = stdout;
+
+  // barreiras a comparar (-b tipo[,tipo...] | -b all)
+  barrier_kind_t kinds[BAR_NKINDS];
+#ifdef USE_CUSTOM_BARRIER
+  kinds[0] = BAR_CONDVAR;
+#else
+  kinds[0] = BAR_PTHREAD;
+#endif
+  int nkinds = 1;
+  int stragglers = 0;         // -S: análise de stragglers após cada experimento
+  int Ts[16], nT = 0;         // -T: equipes simultâneas no pool (0 = uma equipe por vez)
+  int oversub = 0;            // -O: K = nproc × {1/2, 1, 2, 4, 8, 16}
+  pin_mode_t pin = PIN_NONE;  // -p compact|scatter
+  static const struct option longopts[] = {
+    { "repeat", required_argument, NULL, 'R' },
+    { "warmup", required_argument, NULL, 'W' },
+    { "format", required_argument, NULL, 'F' },
+    { "help",   no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "t:k:w:b:s:ST:Op:h", longopts, NULL)) != -1) {
+    if (opt == 't' && (seconds = atof(optarg)) > 0.0) continue;
+    if (opt == 'k' && (nK = parse_ints(optarg, Ks, 16)) > 0) continue;
+    if (opt == 'w' && sscanf(optarg, "%d:%d", &min_ms, &max_ms) == 2 && min_ms >= 0 &&
+        max_ms >= min_ms)
+      continue;
+    if (opt == 'R' && (repeat = atoi(optarg)) > 0) continue;
+    if (opt == 'W' && sscanf(optarg, "%lf", &warmup) == 1 && warmup >= 0.0) continue;
+    if (opt == 'F' && !strcmp(optarg, "csv")) { format = OUT_CSV; continue; }
+    if (opt == 'F' && !strcmp(optarg, "json")) { format = OUT_JSON; continue; }
+    if (opt == 'O') { oversub = 1; continue; }
+    if (opt == 'p' && !strcmp(optarg, "compact")) { pin = PIN_COMPACT; continue; }
+    if (opt == 'p' && !strcmp(optarg, "scatter")) { pin = PIN_SCATTER; continue; }
+    if (opt == 'b' && (nkinds = parse_barriers(optarg, kinds)) > 0) continue;
+    if (opt == 'T' && (nT = parse_ints(optarg, Ts, 16)) > 0) continue;
+    if (opt == 'S') { stragglers = 1; continue; }
+    // -s MIN_NS:MAX_NS (uniforme) ou -s exp:MEDIA_NS: pernas de CPU calibradas
+    if (opt == 's' && sscanf(optarg, "exp:%ld", &leg.mean_ns) == 1 && leg.mean_ns >= 0) {
+      leg.mode = LEG_SPIN_EXP;
+      continue;
+    }
+    if (opt == 's' && sscanf(optarg, "%ld:%ld", &leg.min_ns, &leg.max_ns) == 2 &&
+        leg.min_ns >= 0 && leg.max_ns >= leg.min_ns) {
+      leg.mode = LEG_SPIN_UNIFORM;
+      continue;
+    }
+    fprintf(stderr, "Uso: %s [-t S] [-k K1[,K2...]] [-w MIN_MS:MAX_MS]\n"
+                    "          [-b all|pthread,condvar,sense,futex,tree,dissemination,tournament]\n"
+                    "          [-s MIN_NS:MAX_NS | -s exp:MEDIA_NS] [-S] [-T T1[,T2...]]\n"
+                    "          [-O] [-p compact|scatter]\n"
+                    "          [--repeat R] [--warmup S] [--format text|csv|json]\n", argv[0]);
+    return opt == 'h' ? 0 : 1;
+  }
+
+  // o modo pool mede uma vez e só imprime o texto: sem repetições, aquecimento
+  // nem linhas CSV/JSON
+  if (nT > 0 && (format != OUT_TEXT || repeat != 1 || warmup > 0.0)) {
+    fprintf(stderr, "-T não aceita --format csv|json, --repeat nem --warmup\n");
+    return 1;
+  }
+  leg.min_ms = min_ms;
+  leg.max_ms = max_ms;
+  if (format != OUT_TEXT) log_out = stderr;
+  if (oversub) {
+    int n = online_cpus();
+    nK = 0;
+    if (n / 2 > 0) Ks[nK++] = n / 2;
+    for (int f = 1; f <= 16; f *= 2) Ks[nK++] = n * f;
+  }
+  if (pin != PIN_NONE && pin_setup(pin) == 0)
+    fprintf(stderr, "afinidade indisponível; threads sem fixação\n");
+
+  if (leg.mode == LEG_SLEEP) {
+    fprintf(log_out, "Duração por K: %.2fs | Trabalho aleatório: %d..%d ms\n", seconds, min_ms, max_ms);
+  } else {
+    spin_calibrate();
+    if (leg.mode == LEG_SPIN_UNIFORM)
+      fprintf(log_out, "Duração por K: %.2fs | Trabalho de CPU: %ld..%ld ns", seconds, leg.min_ns, leg.max_ns);
+    else
+      fprintf(log_out, "Duração por K: %.2fs | Trabalho de CPU: exponencial, média %ld ns", seconds, leg.mean_ns);
+    fprintf(log_out, " (calibrado: %.3f iterações/ns)\n", spin_iters_per_ns);
+  }
+  if (pin_ncpus) {
+    fprintf(log_out, "Fixação %s: CPUs", pin_names[pin_mode]);
+    for (int i = 0; i < pin_ncpus; i++) fprintf(log_out, "%c%d", i ? ',' : ' ', pin_cpus[i]);
+    fprintf(log_out, " (corredor i → posição i mod %d)\n", pin_ncpus);
+  }
+  fprintf(log_out, "------------------------------------------------------\n");
+  if (nT > 0) {
+    for (int i = 0; i < nK; i++)
+      for (int j = 0; j < nT; j++) pool_experiment(Ts[j], Ks[i], seconds, &leg);
+    fprintf(log_out, "------------------------------------------------------\n");
+    return 0;
+  }
+  static trials_t tr[16][BAR_NKINDS];
+  for (int i = 0; i < nK; i++)
+    for (int j = 0; j < nkinds; j++)
+      for (int rep = 0; rep < repeat; rep++) {
+        result_t res = run_experiment(Ks[i], kinds[j], seconds, warmup, &leg, stragglers);
+        trials_add(&tr[i][j], &res);
+      }
+  fprintf(log_out, "------------------------------------------------------\n");
 
-  printf("Duração por K: %.2fs | Trabalho aleatório: %d..%d ms\n", seconds, min_ms, max_ms);
-  printf("------------------------------------------------------\n");
-  for (int i = 0; i < nK; i++) {
-    run_experiment(Ks[i], seconds, min_ms, max_ms);
+  if (format == OUT_CSV) {
+    printf("k,barrier,trials,rpm_mean,rpm_stddev,rpm_ci95_lo,rpm_ci95_hi,rounds_s_mean,"
+           "wake_avg_us,wake_max_us,overhead_us,nvcsw_per_round,nivcsw_per_round,cpu_us_per_round\n");
+  } else if (format == OUT_JSON) {
+    printf("[\n");
+  } else if (nkinds > 1 || oversub || repeat > 1) {
+    printf("%-4s %-14s %12s %12s %12s %12s %14s %14s %14s %10s %10s %12s\n", "K", "barreira",
+           "rodadas/s", "RPM", "± IC95", "desvio", "liberação µs", "lib. máx µs", "overhead µs",
+           "cs vol", "cs invol", "CPU µs");
   }
-  printf("------------------------------------------------------\n");
+  for (int i = 0; i < nK; i++)
+    for (int j = 0; j < nkinds; j++) {
+      const trials_t *t = &tr[i][j];
+      double n = t->n, sd = trials_sd(t), ci = trials_ci(t);
+      const result_t *m = &t->sum;
+      if (format == OUT_CSV)
+        printf("%d,%s,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.3f,%.3f,%.2f\n", Ks[i],
+               barrier_names[kinds[j]], t->n, t->rpm_mean, sd, t->rpm_mean - ci, t->rpm_mean + ci,
+               m->rounds_s / n, m->wake_avg_us / n, m->wake_max_us, m->overhead_us / n,
+               m->nvcsw / n, m->nivcsw / n, m->cpu_us / n);
+      else if (format == OUT_JSON)
+        printf("  {\"k\": %d, \"barrier\": \"%s\", \"trials\": %d, \"rpm_mean\": %.2f, "
+               "\"rpm_stddev\": %.2f, \"rpm_ci95\": [%.2f, %.2f], \"rounds_s_mean\": %.2f, "
+               "\"wake_avg_us\": %.2f, \"wake_max_us\": %.2f, \"overhead_us\": %.2f, "
+               "\"nvcsw_per_round\": %.3f, \"nivcsw_per_round\": %.3f, \"cpu_us_per_round\": %.2f}%s\n",
+               Ks[i], barrier_names[kinds[j]], t->n, t->rpm_mean, sd, t->rpm_mean - ci,
+               t->rpm_mean + ci, m->rounds_s / n, m->wake_avg_us / n, m->wake_max_us,
+               m->overhead_us / n, m->nvcsw / n, m->nivcsw / n, m->cpu_us / n,
+               i == nK - 1 && j == nkinds - 1 ? "" : ",");
+      else if (nkinds > 1 || oversub || repeat > 1)
+        printf("%-4d %-14s %12.1f %12.2f %12.2f %12.2f %14.1f %14.1f %14.1f %10.2f %10.2f %12.1f\n",
+               Ks[i], barrier_names[kinds[j]], m->rounds_s / n, t->rpm_mean, ci, sd,
+               m->wake_avg_us / n, m->wake_max_us, m->overhead_us / n, m->nvcsw / n,
+               m->nivcsw / n, m->cpu_us / n);
+    }
+  if (format == OUT_JSON) printf("]\n");
+  else if (format == OUT_TEXT && (nkinds > 1 || oversub || repeat > 1))
+    printf("(médias de %d repetição(ões); cs vol/invol e CPU: por rodada, somando as K threads)\n",
+           repeat);
   return 0;
 }